@@ -1,37 +1,25 @@
 #include <openfhe.h>
+#include "activation_function.h"
+#include "tuner.h"
 #include <algorithm>
 
 using namespace lbcrypto;
-
-Ciphertext<DCRTPoly> sigmoid(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, double lb, double ub, int64_t polyDegree){
-    return cryptoContext->EvalLogistic(arg, lb, ub, polyDegree);
-}
-
-Ciphertext<DCRTPoly> tanh(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, double lb, double ub, int64_t polyDegree){
-    auto temp = sigmoid(cryptoContext, arg, 2 * lb + 1, 2 * ub - 1, polyDegree);
-    return cryptoContext->EvalSub(cryptoContext->EvalMult(2, temp), 1);
-}
-
-Ciphertext<DCRTPoly> swish(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, double lb, double ub, int64_t polyDegree){
-    auto temp = sigmoid(cryptoContext, arg, lb, ub, polyDegree);
-    return cryptoContext->EvalMult(arg, temp);
-}
+using namespace activation;
 
 signed main() {
 
-    CCParams<CryptoContextCKKSRNS> CKKSParams;
-
-    CKKSParams.SetSecurityLevel(HEStd_NotSet);
-    CKKSParams.SetRingDim(1 << 10);
-    int64_t scalingModSize = 50;
-    int64_t firstModSize   = 60;
-    CKKSParams.SetScalingModSize(scalingModSize);
-    CKKSParams.SetFirstModSize(firstModSize);
+    std::vector<double> vectorA = {-4.0, -3.0, -2.0, -1.0, 0.0, 1.0, 2.0, 3.0, 4.0};
+    size_t length = vectorA.size();
+    double lowerBound = *std::min_element(std::begin(vectorA), std::end(vectorA)) - 1;
+    double upperBound = *std::max_element(std::begin(vectorA), std::end(vectorA)) + 1;
 
     uint32_t polyDegree = 16;
-    uint32_t multDepth = 8;
 
-    CKKSParams.SetMultiplicativeDepth(multDepth);
+    tuner::Workload workload;
+    workload.ops = {{tuner::CHEBYSHEV, polyDegree, std::max(-lowerBound, upperBound)}};
+    workload.vectorLength = length;
+    workload.maxInput = std::max(-lowerBound, upperBound);
+    auto CKKSParams = tuner::Tune<CryptoContextCKKSRNS>(workload);
     CryptoContext<DCRTPoly> CKKSContext = GenCryptoContext(CKKSParams);
     CKKSContext->Enable(PKE);
     CKKSContext->Enable(KEYSWITCH);
@@ -41,27 +29,17 @@ signed main() {
     auto CKKSKeypair = CKKSContext->KeyGen();
     CKKSContext->EvalMultKeyGen(CKKSKeypair.secretKey);
 
-    std::vector<double> vectorA = {-4.0, -3.0, -2.0, -1.0, 0.0, 1.0, 2.0, 3.0, 4.0};
-    size_t length = vectorA.size();
     Plaintext plaintext  = CKKSContext->MakeCKKSPackedPlaintext(vectorA);
     auto ciphertext      = CKKSContext->Encrypt(CKKSKeypair.publicKey, plaintext);
 
-    double lowerBound = *std::min_element(std::begin(vectorA), std::end(vectorA)) - 1;
-    double upperBound = *std::max_element(std::begin(vectorA), std::end(vectorA)) + 1;
-    auto resultSigmoid = sigmoid(CKKSContext, ciphertext, lowerBound, upperBound, polyDegree);
-    auto resultTanh = tanh(CKKSContext, ciphertext, lowerBound, upperBound, polyDegree);
-    auto resultSwish = swish(CKKSContext, ciphertext, lowerBound, upperBound, polyDegree);
+    auto results = activations(CKKSContext, ciphertext, lowerBound, upperBound, polyDegree, {SIGMOID, TANH, SWISH, GELU});
 
-    Plaintext plaintextSigmoid, plaintextTanh, plaintextSwish;
-    CKKSContext->Decrypt(CKKSKeypair.secretKey, resultSigmoid, &plaintextSigmoid);
-    CKKSContext->Decrypt(CKKSKeypair.secretKey, resultTanh, &plaintextTanh);
-    CKKSContext->Decrypt(CKKSKeypair.secretKey, resultSwish, &plaintextSwish);
-    plaintextSigmoid->SetLength(length);
-    plaintextTanh->SetLength(length);
-    plaintextSwish->SetLength(length);
-    std::cout << plaintextSigmoid << std::endl;
-    std::cout << plaintextTanh << std::endl;
-    std::cout << plaintextSwish<< std::endl;
+    for (auto result: results){
+        Plaintext plaintext;
+        CKKSContext->Decrypt(CKKSKeypair.secretKey, result, &plaintext);
+        plaintext->SetLength(length);
+        std::cout << plaintext << std::endl;
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <openfhe.h>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace activation {
+
+using namespace lbcrypto;
+
+enum Activation { SIGMOID, TANH, SWISH, GELU };
+
+inline double evaluate(Activation function, double x){
+    switch (function){
+        case SIGMOID: return 1 / (1 + std::exp(-x));
+        case TANH: return std::tanh(x);
+        case SWISH: return x / (1 + std::exp(-x));
+        case GELU: return 0.5 * x * (1 + std::erf(x / std::sqrt(2.0)));
+    }
+    return 0;
+}
+
+// Chebyshev coefficients are cached per (function, lb, ub, degree)
+inline const std::vector <double> &coefficients(Activation function, double lb, double ub, uint32_t polyDegree){
+    static std::map < std::tuple <Activation, double, double, uint32_t>, std::vector <double> > cache;
+    static std::mutex mutex;
+    std::lock_guard <std::mutex> lock(mutex);
+    auto key = std::make_tuple(function, lb, ub, polyDegree);
+    auto it = cache.find(key);
+    if (it == cache.end())
+        it = cache.emplace(key, EvalChebyshevCoefficients([function](double x){ return evaluate(function, x); }, lb, ub, polyDegree)).first;
+    return it->second;
+}
+
+// T_1 .. T_polyDegree of arg mapped from [lb, ub] onto [-1, 1]; T_0 = 1 is left implicit
+inline std::vector < Ciphertext<DCRTPoly> > chebyshevBasis(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, double lb, double ub, uint32_t polyDegree){
+    std::vector < Ciphertext<DCRTPoly> > basis(polyDegree + 1);
+    basis[1] = cryptoContext->EvalAdd(cryptoContext->EvalMult(arg, 2 / (ub - lb)), -(ub + lb) / (ub - lb));
+    for (uint32_t i = 2; i <= polyDegree; ++i){
+        size_t k = i / 2;
+        if (i % 2 == 0){
+            auto square = cryptoContext->EvalSquare(basis[k]);
+            basis[i] = cryptoContext->EvalSub(cryptoContext->EvalAdd(square, square), 1);
+        }
+        else {
+            auto product = cryptoContext->EvalMult(basis[k], basis[k + 1]);
+            basis[i] = cryptoContext->EvalSub(cryptoContext->EvalAdd(product, product), basis[1]);
+        }
+    }
+    return basis;
+}
+
+// evaluates c_0 / 2 + sum c_i T_i with plaintext scalars only, no key switching
+inline Ciphertext<DCRTPoly> combine(CryptoContext<DCRTPoly> cryptoContext, const std::vector < Ciphertext<DCRTPoly> > &basis, const std::vector <double> &coefficients){
+    Ciphertext<DCRTPoly> res;
+    for (size_t i = 1; i < basis.size() && i < coefficients.size(); ++i){
+        if (coefficients[i] == 0)
+            continue;
+        auto term = cryptoContext->EvalMult(basis[i], coefficients[i]);
+        res = res ? cryptoContext->EvalAdd(res, term) : term;
+    }
+    if (!res)
+        res = cryptoContext->EvalMult(basis[1], 0.0);
+    return cryptoContext->EvalAdd(res, coefficients[0] / 2);
+}
+
+// levels consumed by activations(): the affine map, the basis and the coefficient scaling;
+// a single activation needs at most this many
+inline uint32_t activationDepth(uint32_t polyDegree){
+    uint32_t depth = 0;
+    while ((1u << depth) < polyDegree)
+        ++depth;
+    return depth + 2;
+}
+
+// A single activation goes through OpenFHE's Paterson-Stockmeyer evaluation, the path
+// EvalChebyshevFunction takes, which needs fewer relinearizations and one level less than
+// the full basis. With two or more, the basis of arg is built once and shared.
+inline std::vector < Ciphertext<DCRTPoly> > activations(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, double lb, double ub, uint32_t polyDegree, const std::vector <Activation> &functions){
+    if (functions.size() == 1)
+        return {cryptoContext->EvalChebyshevSeries(arg, coefficients(functions[0], lb, ub, polyDegree), lb, ub)};
+    auto basis = chebyshevBasis(cryptoContext, arg, lb, ub, polyDegree);
+    std::vector < Ciphertext<DCRTPoly> > res;
+    for (auto function: functions)
+        res.push_back(combine(cryptoContext, basis, coefficients(function, lb, ub, polyDegree)));
+    return res;
+}
+
+inline Ciphertext<DCRTPoly> sigmoid(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, double lb, double ub, int64_t polyDegree){
+    return activations(cryptoContext, arg, lb, ub, polyDegree, {SIGMOID})[0];
+}
+
+inline Ciphertext<DCRTPoly> tanh(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, double lb, double ub, int64_t polyDegree){
+    return activations(cryptoContext, arg, lb, ub, polyDegree, {TANH})[0];
+}
+
+inline Ciphertext<DCRTPoly> swish(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, double lb, double ub, int64_t polyDegree){
+    return activations(cryptoContext, arg, lb, ub, polyDegree, {SWISH})[0];
+}
+
+inline Ciphertext<DCRTPoly> gelu(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, double lb, double ub, int64_t polyDegree){
+    return activations(cryptoContext, arg, lb, ub, polyDegree, {GELU})[0];
+}
+
+}
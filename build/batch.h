@@ -0,0 +1,88 @@
+#pragma once
+
+#include <openfhe.h>
+#include <omp.h>
+#include <algorithm>
+#include <exception>
+#include <utility>
+#include <vector>
+
+// Batch execution of independent ciphertext operations. Work is split into contiguous
+// static chunks, one per thread, so that with OMP_PROC_BIND=close every thread keeps
+// touching the ciphertexts it allocated itself. While a batch runs, nested parallelism
+// is disabled so OpenFHE's own parallel loops run on the calling thread instead of
+// oversubscribing the cores.
+namespace batch {
+
+inline size_t &threadCount(){
+    static size_t count = 0;
+    return count;
+}
+
+// 0 uses every thread OpenMP made available at startup. The count also becomes OpenMP's
+// default, so that OpenFHE's own loops on the sequential path stay within it.
+inline void SetThreadCount(size_t count){
+    static int defaultThreads = omp_get_max_threads();
+    threadCount() = count;
+    omp_set_num_threads(count == 0 ? defaultThreads : static_cast<int>(count));
+}
+
+inline size_t GetThreadCount(){
+    return threadCount() == 0 ? static_cast<size_t>(omp_get_max_threads()) : threadCount();
+}
+
+template <typename F>
+void ParallelFor(size_t count, F body){
+    size_t threads = std::min(GetThreadCount(), count);
+    if (threads <= 1){
+        for (size_t i = 0; i < count; ++i)
+            body(i);
+        return;
+    }
+
+    int maxActiveLevels = omp_get_max_active_levels();
+    omp_set_max_active_levels(1);
+    std::exception_ptr error = nullptr;
+    size_t chunk = (count + threads - 1) / threads;
+    #pragma omp parallel for num_threads(threads) schedule(static, chunk)
+    for (size_t i = 0; i < count; ++i){
+        try {
+            body(i);
+        }
+        catch (...){
+            #pragma omp critical
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    omp_set_max_active_levels(maxActiveLevels);
+    if (error)
+        std::rethrow_exception(error);
+}
+
+inline std::vector < lbcrypto::Ciphertext<lbcrypto::DCRTPoly> > EncryptMany(lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext, lbcrypto::PublicKey<lbcrypto::DCRTPoly> publicKey, const std::vector <lbcrypto::Plaintext> &plaintexts){
+    std::vector < lbcrypto::Ciphertext<lbcrypto::DCRTPoly> > res(plaintexts.size());
+    ParallelFor(plaintexts.size(), [&](size_t i){
+        res[i] = cryptoContext->Encrypt(publicKey, plaintexts[i]);
+    });
+    return res;
+}
+
+inline std::vector < lbcrypto::Ciphertext<lbcrypto::DCRTPoly> > EvalMultMany(lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext, const std::vector < std::pair < lbcrypto::Ciphertext<lbcrypto::DCRTPoly>, lbcrypto::Ciphertext<lbcrypto::DCRTPoly> > > &pairs){
+    std::vector < lbcrypto::Ciphertext<lbcrypto::DCRTPoly> > res(pairs.size());
+    ParallelFor(pairs.size(), [&](size_t i){
+        res[i] = cryptoContext->EvalMult(pairs[i].first, pairs[i].second);
+    });
+    return res;
+}
+
+// plaintexts should be encoded once beforehand so the encoding tables are already built
+inline std::vector <lbcrypto::Plaintext> DecryptMany(lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext, lbcrypto::PrivateKey<lbcrypto::DCRTPoly> secretKey, const std::vector < lbcrypto::Ciphertext<lbcrypto::DCRTPoly> > &ciphertexts){
+    std::vector <lbcrypto::Plaintext> res(ciphertexts.size());
+    ParallelFor(ciphertexts.size(), [&](size_t i){
+        cryptoContext->Decrypt(secretKey, ciphertexts[i], &res[i]);
+    });
+    return res;
+}
+
+}
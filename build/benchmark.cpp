@@ -0,0 +1,394 @@
+#include <openfhe.h>
+#include "activation_function.h"
+#include "batch.h"
+#include "matrix_multiplication.h"
+#include "relu.h"
+#include "tuner.h"
+#include <sys/resource.h>
+#include <omp.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace lbcrypto;
+
+// Sweeps every operator over BGV, BFV and CKKS and prints one JSON document:
+//   benchmark [--quick] [--iterations N] [--output FILE] [--store DIR]
+// The scheme-switching context is kept in the key store DIR, or in a temporary directory
+// that is removed afterwards. Matrix products are checked against the cleartext product.
+// --quick runs the smallest configuration that still fits the 32x32 matrix product and is
+// deep enough for the activations.
+
+struct Config {
+    std::string scheme;
+    uint32_t ringDim, depth, batchSize, threads;
+};
+
+struct Result {
+    Config config;
+    std::string op;
+    std::vector <double> millis;
+    int64_t ciphertextBytes = -1;
+    int64_t levels = -1;
+    long peakRSS = 0;
+    std::string error;
+};
+
+// Writing 5 to clear_refs resets VmHWM to the current resident set, so the peak read after
+// a row covers that row alone. Without procfs the process-lifetime peak is all there is.
+void resetPeakRSS(){
+    std::ofstream("/proc/self/clear_refs") << "5" << std::flush;
+}
+
+long peakRSS(){
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stol(line.substr(6));
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+size_t serializedBytes(Ciphertext<DCRTPoly> ciphertext){
+    std::stringstream stream;
+    Serial::Serialize(ciphertext, stream, SerType::BINARY);
+    return stream.str().size();
+}
+
+int64_t levelsConsumed(const std::string &scheme, Ciphertext<DCRTPoly> input, Ciphertext<DCRTPoly> output){
+    if (scheme == "BFV")
+        return 0;
+    return static_cast<int64_t>(output->GetLevel() + output->GetNoiseScaleDeg()) - static_cast<int64_t>(input->GetLevel() + input->GetNoiseScaleDeg());
+}
+
+double percentile(std::vector <double> values, double q){
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(std::ceil(q * values.size()));
+    return values[std::max<size_t>(index, 1) - 1];
+}
+
+// body returns the ciphertext it produced, or nullptr when the result is decrypted inside
+Result measure(const Config &config, const std::string &op, size_t iterations, Ciphertext<DCRTPoly> input, std::function < Ciphertext<DCRTPoly>() > body){
+    Result result;
+    result.config = config;
+    result.op = op;
+    resetPeakRSS();
+    try {
+        auto output = body();
+        if (output){
+            result.ciphertextBytes = serializedBytes(output);
+            if (input)
+                result.levels = levelsConsumed(config.scheme, input, output);
+        }
+        for (size_t i = 0; i < iterations; ++i){
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            result.millis.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+    }
+    catch (const std::exception &e){
+        result.error = e.what();
+    }
+    result.peakRSS = peakRSS();
+    return result;
+}
+
+std::string escape(const std::string &text){
+    std::string res;
+    for (char c: text){
+        if (c == '"' || c == '\\')
+            res += '\\';
+        if (static_cast<unsigned char>(c) < 0x20)
+            res += ' ';
+        else
+            res += c;
+    }
+    return res;
+}
+
+void writeJSON(std::ostream &out, const std::vector <Result> &results){
+    out << "{\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i){
+        const auto &r = results[i];
+        double mean = 0;
+        for (auto t: r.millis)
+            mean += t;
+        mean = r.millis.empty() ? 0 : mean / r.millis.size();
+        out << (i ? "," : "") << "\n    {";
+        out << "\"scheme\": \"" << r.config.scheme << "\", ";
+        out << "\"op\": \"" << r.op << "\", ";
+        out << "\"ring_dim\": " << r.config.ringDim << ", ";
+        out << "\"depth\": " << r.config.depth << ", ";
+        out << "\"batch_size\": " << r.config.batchSize << ", ";
+        out << "\"threads\": " << r.config.threads << ", ";
+        out << "\"iterations\": " << r.millis.size() << ", ";
+        out << "\"p50_ms\": " << percentile(r.millis, 0.5) << ", ";
+        out << "\"p99_ms\": " << percentile(r.millis, 0.99) << ", ";
+        out << "\"ops_per_sec\": " << (mean > 0 ? 1000 / mean : 0) << ", ";
+        out << "\"peak_rss_kb\": " << r.peakRSS << ", ";
+        out << "\"ciphertext_bytes\": ";
+        if (r.ciphertextBytes < 0)
+            out << "null, ";
+        else
+            out << r.ciphertextBytes << ", ";
+        out << "\"levels_consumed\": ";
+        if (r.levels < 0)
+            out << "null";
+        else
+            out << r.levels;
+        if (!r.error.empty())
+            out << ", \"error\": \"" << escape(r.error) << "\"";
+        out << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+
+constexpr size_t MATRIX_SIZE = 32;
+constexpr int MATRIX_MAX = 99;
+
+CryptoContext<DCRTPoly> makeContext(const Config &config){
+    // large enough for the matrix dot products, which are summed under encryption
+    uint64_t plaintextModulus = tuner::plaintextModulus(MATRIX_SIZE * MATRIX_MAX * MATRIX_MAX, config.ringDim);
+    CryptoContext<DCRTPoly> cryptoContext;
+    if (config.scheme == "BGV"){
+        CCParams<CryptoContextBGVRNS> params;
+        params.SetMultiplicativeDepth(config.depth);
+        params.SetPlaintextModulus(plaintextModulus);
+        params.SetRingDim(config.ringDim);
+        params.SetBatchSize(config.batchSize);
+        cryptoContext = GenCryptoContext(params);
+    }
+    else if (config.scheme == "BFV"){
+        CCParams<CryptoContextBFVRNS> params;
+        params.SetMultiplicativeDepth(config.depth);
+        params.SetPlaintextModulus(plaintextModulus);
+        params.SetRingDim(config.ringDim);
+        params.SetBatchSize(config.batchSize);
+        cryptoContext = GenCryptoContext(params);
+    }
+    else {
+        CCParams<CryptoContextCKKSRNS> params;
+        params.SetMultiplicativeDepth(config.depth);
+        params.SetScalingModSize(50);
+        params.SetRingDim(config.ringDim);
+        params.SetBatchSize(config.batchSize);
+        cryptoContext = GenCryptoContext(params);
+    }
+    cryptoContext->Enable(PKE);
+    cryptoContext->Enable(KEYSWITCH);
+    cryptoContext->Enable(LEVELEDSHE);
+    cryptoContext->Enable(ADVANCEDSHE);
+    return cryptoContext;
+}
+
+template <typename T>
+std::vector < std::vector <T> > randomMatrix(std::mt19937 &gen, size_t rows, size_t columns){
+    std::uniform_int_distribution<int> dist(0, MATRIX_MAX);
+    std::vector < std::vector <T> > res(rows, std::vector <T>(columns));
+    for (auto &row: res)
+        for (auto &x: row)
+            x = dist(gen);
+    return res;
+}
+
+template <typename T>
+std::vector < std::vector <T> > product(const std::vector < std::vector <T> > &A, const std::vector < std::vector <T> > &B){
+    std::vector < std::vector <T> > res(A.size(), std::vector <T>(B[0].size(), 0));
+    for (size_t i = 0; i < A.size(); ++i)
+        for (size_t k = 0; k < B.size(); ++k)
+            for (size_t j = 0; j < B[0].size(); ++j)
+                res[i][j] += A[i][k] * B[k][j];
+    return res;
+}
+
+// times the encrypted A * B and fails the row when it differs from the cleartext product:
+// exactly under BGV/BFV, by more than 2^-20 of the largest possible entry under CKKS
+template <typename T>
+Result measureProduct(const Config &config, const std::string &op, size_t iterations, CryptoContext<DCRTPoly> cryptoContext, KeyPair<DCRTPoly> keyPair, std::mt19937 &gen, size_t m, size_t l, size_t n){
+    auto A = randomMatrix<T>(gen, m, l);
+    auto B = randomMatrix<T>(gen, l, n);
+    auto expected = product(A, B);
+    double tolerance = std::is_integral<T>::value ? 0 : l * MATRIX_MAX * MATRIX_MAX * std::ldexp(1.0, -20);
+    return measure(config, op, iterations, nullptr, [&](){
+        auto res = matmul::multiply(cryptoContext, keyPair, A, B);
+        for (size_t i = 0; i < m; ++i)
+            for (size_t j = 0; j < n; ++j)
+                if (std::abs(static_cast<double>(res[i][j]) - static_cast<double>(expected[i][j])) > tolerance)
+                    throw std::runtime_error("entry (" + std::to_string(i) + ", " + std::to_string(j) + ") is " + std::to_string(res[i][j]) + ", expected " + std::to_string(expected[i][j]));
+        return Ciphertext<DCRTPoly>();
+    });
+}
+
+void runConfig(const Config &config, size_t iterations, std::vector <Result> &results){
+    CryptoContext<DCRTPoly> cryptoContext;
+    try {
+        cryptoContext = makeContext(config);
+    }
+    catch (const std::exception &e){
+        Result result;
+        result.config = config;
+        result.op = "context";
+        result.error = e.what();
+        result.peakRSS = peakRSS();
+        results.push_back(result);
+        return;
+    }
+
+    const uint32_t polyDegree = 16;
+    auto keyPair = cryptoContext->KeyGen();
+    cryptoContext->EvalMultKeyGen(keyPair.secretKey);
+    cryptoContext->EvalRotateKeyGen(keyPair.secretKey, matmul::reduceIndices(MATRIX_SIZE));
+
+    std::mt19937 gen(42);
+    bool ckks = config.scheme == "CKKS";
+    Ciphertext<DCRTPoly> a, b;
+    if (ckks){
+        std::uniform_real_distribution<double> dist(-4, 4);
+        std::vector <double> x(config.batchSize), y(config.batchSize);
+        for (size_t i = 0; i < x.size(); ++i){
+            x[i] = dist(gen);
+            y[i] = dist(gen);
+        }
+        a = cryptoContext->Encrypt(keyPair.publicKey, cryptoContext->MakeCKKSPackedPlaintext(x));
+        b = cryptoContext->Encrypt(keyPair.publicKey, cryptoContext->MakeCKKSPackedPlaintext(y));
+    }
+    else {
+        std::uniform_int_distribution<int64_t> dist(-100, 100);
+        std::vector <int64_t> x(config.batchSize), y(config.batchSize);
+        for (size_t i = 0; i < x.size(); ++i){
+            x[i] = dist(gen);
+            y[i] = dist(gen);
+        }
+        a = cryptoContext->Encrypt(keyPair.publicKey, cryptoContext->MakePackedPlaintext(x));
+        b = cryptoContext->Encrypt(keyPair.publicKey, cryptoContext->MakePackedPlaintext(y));
+    }
+
+    batch::SetThreadCount(config.threads);
+
+    results.push_back(measure(config, "add", iterations, a, [&](){
+        return cryptoContext->EvalAdd(a, b);
+    }));
+    results.push_back(measure(config, "multiply", iterations, a, [&](){
+        return cryptoContext->EvalMult(a, b);
+    }));
+
+    // with n * l twice the slot count, the inner dimension is split into chunks and the
+    // planner sums their products before a single relinearization
+    size_t chunkedColumns = std::max<size_t>(1, 2 * matmul::slotCount(cryptoContext) / MATRIX_SIZE);
+    if (ckks){
+        results.push_back(measureProduct<double>(config, "matrix_multiplication", iterations, cryptoContext, keyPair, gen, MATRIX_SIZE, MATRIX_SIZE, MATRIX_SIZE));
+        results.push_back(measureProduct<double>(config, "matrix_multiplication_chunked", iterations, cryptoContext, keyPair, gen, 4, MATRIX_SIZE, chunkedColumns));
+    }
+    else {
+        results.push_back(measureProduct<int64_t>(config, "matrix_multiplication", iterations, cryptoContext, keyPair, gen, MATRIX_SIZE, MATRIX_SIZE, MATRIX_SIZE));
+        results.push_back(measureProduct<int64_t>(config, "matrix_multiplication_chunked", iterations, cryptoContext, keyPair, gen, 4, MATRIX_SIZE, chunkedColumns));
+    }
+
+    if (ckks && config.depth >= activation::activationDepth(polyDegree)){
+        results.push_back(measure(config, "sigmoid", iterations, a, [&](){
+            return activation::sigmoid(cryptoContext, a, -5, 5, polyDegree);
+        }));
+        results.push_back(measure(config, "activations_fused", iterations, a, [&](){
+            auto res = activation::activations(cryptoContext, a, -5, 5, polyDegree, {activation::SIGMOID, activation::TANH, activation::SWISH, activation::GELU});
+            return res.back();
+        }));
+    }
+}
+
+void runSchemeSwitching(const std::string &storeDir, size_t iterations, std::vector <Result> &results){
+    auto store = relu::schemeSwitchingContext(storeDir);
+    auto cryptoContext = store.cryptoContext;
+    Config config = {"CKKS", cryptoContext->GetRingDimension(), 17, relu::SLOTS, static_cast<uint32_t>(batch::GetThreadCount())};
+    std::vector <double> vec = {91, 140, 204, 50, 70, 129, 98, 57, 91, 140, 204, 50, 70, 129, 52, 52};
+    auto ciphertext = cryptoContext->Encrypt(store.keyPair.publicKey, cryptoContext->MakeCKKSPackedPlaintext(vec));
+    results.push_back(measure(config, "min_scheme_switching", iterations, ciphertext, [&](){
+        return cryptoContext->EvalMinSchemeSwitching(ciphertext, store.keyPair.publicKey, relu::SLOTS, relu::SLOTS)[0];
+    }));
+
+    relu::ComparisonOptions options;
+    options.bound = 256;
+    options.backend = relu::SCHEME_SWITCHING;
+    results.push_back(measure(config, "relu_scheme_switching", iterations, ciphertext, [&](){
+        return relu::ReLU(cryptoContext, ciphertext, options);
+    }));
+    options.backend = relu::POLYNOMIAL;
+    options.gap = 48;
+    options.precisionBits = 4;
+    results.push_back(measure(config, "relu_polynomial", iterations, ciphertext, [&](){
+        return relu::ReLU(cryptoContext, ciphertext, options);
+    }));
+}
+
+signed main(int argc, char *argv[]){
+    bool quick = false;
+    size_t iterations = 20;
+    std::string output;
+    std::string storeDir;
+    for (int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if (arg == "--quick")
+            quick = true;
+        else if (arg == "--iterations" && i + 1 < argc)
+            iterations = std::stoul(argv[++i]);
+        else if (arg == "--output" && i + 1 < argc)
+            output = argv[++i];
+        else if (arg == "--store" && i + 1 < argc)
+            storeDir = argv[++i];
+    }
+
+    uint32_t maxThreads = omp_get_max_threads();
+    std::vector <uint32_t> ringDims = {8192, 16384};
+    std::vector <uint32_t> depths = {3, 8};
+    std::vector <uint32_t> batchSizes = {16, 4096};
+    std::vector <uint32_t> threads = {1, maxThreads};
+    if (quick){
+        ringDims = {16384};
+        depths = {6};
+        batchSizes = {4096};
+        threads = {maxThreads};
+    }
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+
+    std::vector <Result> results;
+    for (std::string scheme: {"BGV", "BFV", "CKKS"})
+        for (auto ringDim: ringDims)
+            for (auto depth: depths)
+                for (auto batchSize: batchSizes)
+                    for (auto threadCount: threads)
+                        runConfig({scheme, ringDim, depth, batchSize, threadCount}, iterations, results);
+    batch::SetThreadCount(maxThreads);
+    bool temporaryStore = storeDir.empty();
+    if (temporaryStore){
+        std::string pattern = (std::filesystem::temp_directory_path() / "benchmark-keys-XXXXXX").string();
+        if (!mkdtemp(pattern.data()))
+            throw std::runtime_error("cannot create a temporary key store");
+        storeDir = pattern;
+    }
+    runSchemeSwitching(storeDir, std::min<size_t>(iterations, 3), results);
+    if (temporaryStore)
+        std::filesystem::remove_all(storeDir);
+
+    if (output.empty())
+        writeJSON(std::cout, results);
+    else {
+        std::ofstream file(output);
+        writeJSON(file, results);
+    }
+
+    return 0;
+}
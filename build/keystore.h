@@ -0,0 +1,217 @@
+#pragma once
+
+#include <openfhe.h>
+#include "ciphertext-ser.h"
+#include "cryptocontext-ser.h"
+#include "key/key-ser.h"
+#include "scheme/ckksrns/ckksrns-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+#include "scheme/bgvrns/bgvrns-ser.h"
+#include "binfhecontext-ser.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// On-disk store for a crypto context and its keys. Every evaluation key lives in its own
+// binary file, so a process only maps the rotation keys it asks for. Rotation keys are
+// filed under their automorphism index, which also covers EvalSum keys and the
+// CKKS-to-FHEW switching key kept in the automorphism map.
+//
+// <dir>/VERSION                  store format version
+// <dir>/context.bin, publicKey.bin, secretKey.bin, multKey.bin
+// <dir>/rotation/<index>.bin     one automorphism key per file
+// <dir>/schemeswitch/*.bin       FHEW context, bootstrapping keys and FHEW-to-CKKS key
+namespace keystore {
+
+constexpr uint32_t VERSION = 1;
+
+class MappedBuffer : public std::streambuf {
+public:
+    explicit MappedBuffer(const std::string &path){
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("cannot open " + path);
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0){
+            close(fd);
+            throw std::runtime_error("cannot map " + path);
+        }
+        size = info.st_size;
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED){
+            close(fd);
+            throw std::runtime_error("cannot map " + path);
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<char *>(mapped);
+        setg(data, data, data + size);
+    }
+    ~MappedBuffer(){
+        munmap(data, size);
+        close(fd);
+    }
+    MappedBuffer(const MappedBuffer &) = delete;
+    MappedBuffer &operator=(const MappedBuffer &) = delete;
+
+private:
+    int fd;
+    size_t size;
+    char *data;
+};
+
+template <typename T>
+void Read(const std::string &path, T &obj){
+    MappedBuffer buffer(path);
+    std::istream stream(&buffer);
+    lbcrypto::Serial::Deserialize(obj, stream, lbcrypto::SerType::BINARY);
+}
+
+template <typename T>
+void Write(const std::string &path, const T &obj){
+    if (!lbcrypto::Serial::SerializeToFile(path, obj, lbcrypto::SerType::BINARY))
+        throw std::runtime_error("cannot write " + path);
+}
+
+// the file is created owner-only before anything is written to it
+template <typename T>
+void WritePrivate(const std::string &path, const T &obj){
+    std::filesystem::remove(path);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        throw std::runtime_error("cannot create " + path);
+    close(fd);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    lbcrypto::Serial::Serialize(obj, file, lbcrypto::SerType::BINARY);
+    if (!file)
+        throw std::runtime_error("cannot write " + path);
+}
+
+struct Store {
+    lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext;
+    lbcrypto::KeyPair<lbcrypto::DCRTPoly> keyPair;
+};
+
+inline bool Exists(const std::string &dir){
+    std::ifstream file(dir + "/VERSION");
+    uint32_t version = 0;
+    return file >> version && version == VERSION;
+}
+
+// state created by EvalCKKStoFHEWSetup/EvalCKKStoFHEWKeyGen that is not part of the CKKS
+// context or its automorphism keys
+inline void SaveSchemeSwitch(const std::string &dir, lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext){
+    std::filesystem::create_directories(dir + "/schemeswitch");
+    auto ccLWE = cryptoContext->GetBinCCForSchemeSwitch();
+    Write(dir + "/schemeswitch/context.bin", *ccLWE);
+    Write(dir + "/schemeswitch/refreshKey.bin", ccLWE->GetRefreshKey());
+    Write(dir + "/schemeswitch/switchKey.bin", ccLWE->GetSwitchKey());
+    Write(dir + "/schemeswitch/FHEWtoCKKSKey.bin", cryptoContext->GetSwkFC());
+}
+
+// keyPair.secretKey may be null when the store is meant for an evaluation-only host;
+// schemeSwitch also saves the state of EvalCKKStoFHEWSetup, before the store is marked valid
+inline void Save(const std::string &dir, lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext, const lbcrypto::KeyPair<lbcrypto::DCRTPoly> &keyPair, bool schemeSwitch = false){
+    // keys of an earlier key pair must not survive next to the new ones
+    std::filesystem::remove(dir + "/VERSION");
+    std::filesystem::remove_all(dir + "/rotation");
+    std::filesystem::create_directories(dir + "/rotation");
+    Write(dir + "/context.bin", cryptoContext);
+    Write(dir + "/publicKey.bin", keyPair.publicKey);
+    if (keyPair.secretKey)
+        WritePrivate(dir + "/secretKey.bin", keyPair.secretKey);
+
+    std::string keyTag = keyPair.publicKey->GetKeyTag();
+    {
+        std::ofstream multKey(dir + "/multKey.bin", std::ios::binary);
+        if (!cryptoContext->SerializeEvalMultKey(multKey, lbcrypto::SerType::BINARY, keyTag))
+            throw std::runtime_error("cannot write " + dir + "/multKey.bin");
+        multKey.close();
+        if (!multKey)
+            throw std::runtime_error("cannot write " + dir + "/multKey.bin");
+    }
+
+    auto &automorphismKeys = cryptoContext->GetAllEvalAutomorphismKeys();
+    auto keyMap = automorphismKeys.find(keyTag);
+    if (keyMap != automorphismKeys.end())
+        for (const auto &entry: *keyMap->second)
+            Write(dir + "/rotation/" + std::to_string(entry.first) + ".bin", entry.second);
+
+    if (schemeSwitch)
+        SaveSchemeSwitch(dir, cryptoContext);
+
+    // written last so an interrupted save is never picked up as a valid store
+    std::ofstream(dir + "/VERSION") << VERSION << std::endl;
+}
+
+// loads the context, key pair and relinearization keys; rotation keys stay on disk
+inline Store Load(const std::string &dir){
+    if (!Exists(dir))
+        throw std::runtime_error(dir + " is not a key store of version " + std::to_string(VERSION));
+    Store store;
+    Read(dir + "/context.bin", store.cryptoContext);
+    Read(dir + "/publicKey.bin", store.keyPair.publicKey);
+    if (std::filesystem::exists(dir + "/secretKey.bin"))
+        Read(dir + "/secretKey.bin", store.keyPair.secretKey);
+
+    MappedBuffer buffer(dir + "/multKey.bin");
+    std::istream multKey(&buffer);
+    if (!store.cryptoContext->DeserializeEvalMultKey(multKey, lbcrypto::SerType::BINARY))
+        throw std::runtime_error("cannot read " + dir + "/multKey.bin");
+    return store;
+}
+
+inline void LoadAutomorphismKeys(const std::string &dir, lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext, const std::vector <uint32_t> &autoIndices, const std::string &keyTag){
+    auto keyMap = std::make_shared < std::map < uint32_t, lbcrypto::EvalKey<lbcrypto::DCRTPoly> > >();
+    for (auto autoIndex: autoIndices){
+        lbcrypto::EvalKey<lbcrypto::DCRTPoly> key;
+        Read(dir + "/rotation/" + std::to_string(autoIndex) + ".bin", key);
+        (*keyMap)[autoIndex] = key;
+    }
+    if (!keyMap->empty())
+        cryptoContext->InsertEvalAutomorphismKey(keyMap, keyTag);
+}
+
+// maps only the keys needed for the given EvalRotate indices
+inline void LoadRotationKeys(const std::string &dir, lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext, const std::vector <int32_t> &indices, const std::string &keyTag){
+    std::vector <uint32_t> autoIndices;
+    for (auto index: indices)
+        autoIndices.push_back(cryptoContext->FindAutomorphismIndex(index));
+    LoadAutomorphismKeys(dir, cryptoContext, autoIndices, keyTag);
+}
+
+inline void LoadAllRotationKeys(const std::string &dir, lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext, const std::string &keyTag){
+    std::vector <uint32_t> autoIndices;
+    for (const auto &entry: std::filesystem::directory_iterator(dir + "/rotation")){
+        // anything but <index>.bin is not a key this store wrote
+        std::string stem = entry.path().stem().string();
+        if (!entry.is_regular_file() || entry.path().extension() != ".bin" || stem.empty() || stem.size() > 9 || stem.find_first_not_of("0123456789") != std::string::npos)
+            continue;
+        autoIndices.push_back(std::stoul(stem));
+    }
+    LoadAutomorphismKeys(dir, cryptoContext, autoIndices, keyTag);
+}
+
+inline void LoadSchemeSwitch(const std::string &dir, lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cryptoContext){
+    auto ccLWE = std::make_shared<lbcrypto::BinFHEContext>();
+    Read(dir + "/schemeswitch/context.bin", *ccLWE);
+
+    lbcrypto::RingGSWBTKey BTKey;
+    Read(dir + "/schemeswitch/refreshKey.bin", BTKey.BSkey);
+    Read(dir + "/schemeswitch/switchKey.bin", BTKey.KSkey);
+    ccLWE->BTKeyLoad(BTKey);
+    cryptoContext->SetBinCCForSchemeSwitch(ccLWE);
+
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly> FHEWtoCKKSKey;
+    Read(dir + "/schemeswitch/FHEWtoCKKSKey.bin", FHEWtoCKKSKey);
+    cryptoContext->SetSwkFC(FHEWtoCKKSKey);
+}
+
+}
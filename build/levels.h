@@ -0,0 +1,55 @@
+#pragma once
+
+#include <openfhe.h>
+
+// Level bookkeeping shared by the operators. FIXEDMANUAL leaves rescaling and level
+// alignment to the caller; under the other scaling techniques OpenFHE does both itself and
+// these helpers reduce to the plain Eval calls.
+namespace levels {
+
+using namespace lbcrypto;
+
+inline bool manualRescale(CryptoContext<DCRTPoly> cryptoContext){
+    if (cryptoContext->getSchemeId() == BFVRNS_SCHEME)
+        return false;
+    auto cryptoParams = std::dynamic_pointer_cast<CryptoParametersRNS>(cryptoContext->GetCryptoParameters());
+    return cryptoParams->GetScalingTechnique() == FIXEDMANUAL;
+}
+
+inline void align(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> &a, Ciphertext<DCRTPoly> &b){
+    if (!manualRescale(cryptoContext))
+        return;
+    if (a->GetLevel() < b->GetLevel())
+        a = cryptoContext->LevelReduce(a, nullptr, b->GetLevel() - a->GetLevel());
+    else if (b->GetLevel() < a->GetLevel())
+        b = cryptoContext->LevelReduce(b, nullptr, a->GetLevel() - b->GetLevel());
+}
+
+inline Ciphertext<DCRTPoly> mult(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> a, Ciphertext<DCRTPoly> b){
+    align(cryptoContext, a, b);
+    auto res = cryptoContext->EvalMult(a, b);
+    return manualRescale(cryptoContext) ? cryptoContext->Rescale(res) : res;
+}
+
+inline Ciphertext<DCRTPoly> mult(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> a, double b){
+    auto res = cryptoContext->EvalMult(a, b);
+    return manualRescale(cryptoContext) ? cryptoContext->Rescale(res) : res;
+}
+
+inline Ciphertext<DCRTPoly> add(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> a, Ciphertext<DCRTPoly> b){
+    align(cryptoContext, a, b);
+    return cryptoContext->EvalAdd(a, b);
+}
+
+inline Ciphertext<DCRTPoly> sub(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> a, Ciphertext<DCRTPoly> b){
+    align(cryptoContext, a, b);
+    return cryptoContext->EvalSub(a, b);
+}
+
+inline size_t remainingLevels(Ciphertext<DCRTPoly> ciphertext){
+    size_t towers = ciphertext->GetElements()[0].GetNumOfElements();
+    size_t pending = ciphertext->GetNoiseScaleDeg() - 1;
+    return towers > pending + 1 ? towers - pending - 1 : 0;
+}
+
+}
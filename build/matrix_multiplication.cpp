@@ -1,7 +1,10 @@
 #include <openfhe.h>
+#include "matrix_multiplication.h"
+#include "tuner.h"
 #include <vector>
 
 using namespace lbcrypto;
+using namespace matmul;
 
 std::vector < std::vector <int64_t> > vectorA = {
     {30, 42, 47, 45, 98, 65, 99, 1, 31, 19, 72, 10, 27, 33, 87, 98, 10, 40, 31, 38, 59, 5, 62, 68, 61, 99, 12, 49, 56, 45, 9, 46},
@@ -165,104 +168,35 @@ std::vector < std::vector <double> > vectorH = {
     {9.51, 90.7, 58.33, 57.43}
 };
 
-std::vector < std::vector < Ciphertext<DCRTPoly> > > helper(CryptoContext<DCRTPoly> cryptoContext, std::vector < Ciphertext<DCRTPoly> > arg1, std::vector < Ciphertext<DCRTPoly> > arg2, size_t m, size_t l, size_t p){
-    std::vector < std::vector < Ciphertext<DCRTPoly> > > res(m, std::vector < Ciphertext<DCRTPoly> >(p));
-    for (size_t i = 0; i < m; ++i){
-        for (size_t j = 0; j < p; ++j){
-            res[i][j] = cryptoContext->EvalMult(arg1[i], arg2[j]);
-        }
-    }
-    return res;
-}
-
-std::vector < std::vector <int64_t> > multiply(CryptoContext<DCRTPoly> cryptoContext, KeyPair<DCRTPoly> keyPair, std::vector < std::vector <int64_t> > arg1, std::vector < std::vector <int64_t> > arg2){
-    size_t m = arg1.size(), l = arg1[0].size(), n = arg2[0].size();
-    std::vector < lbcrypto::Ciphertext<lbcrypto::DCRTPoly> > ciphertextArg1, ciphertextArg2;
-    for (size_t i = 0; i < m; ++i){
-        lbcrypto::Plaintext plaintext = cryptoContext->MakePackedPlaintext(arg1[i]);
-        ciphertextArg1.push_back(cryptoContext->Encrypt(keyPair.publicKey, plaintext));
-    }
-    for (size_t j = 0; j < n; ++j){
-        std::vector <int64_t> temp;
-        for (size_t i = 0; i < l; ++i)
-            temp.push_back(arg2[i][j]);
-        lbcrypto::Plaintext plaintext = cryptoContext->MakePackedPlaintext(temp);
-        ciphertextArg2.push_back(cryptoContext->Encrypt(keyPair.publicKey, plaintext));
-    }
-
-    std::vector < std::vector <int64_t> > res(m, std::vector<int64_t>(n));
-    auto encryptedRes = helper(cryptoContext, ciphertextArg1, ciphertextArg2, m, l, n);
-    for (size_t i = 0; i < m; ++i){
-        for (size_t j = 0; j < n; ++j){
-            int64_t sum = 0;
-            Plaintext plaintextJ;
-            cryptoContext->Decrypt(keyPair.secretKey, encryptedRes[i][j], &plaintextJ);
-            for (size_t k = 0; k < l; ++k){
-                sum += plaintextJ->GetPackedValue()[k];
-            }
-            res[i][j] = sum;
-        }
-    }
-
-    return res;
-}
-
-std::vector < std::vector <double> > multiply(CryptoContext<DCRTPoly> cryptoContext, KeyPair<DCRTPoly> keyPair, std::vector < std::vector <double> > arg1, std::vector < std::vector <double> > arg2){
-    size_t m = arg1.size(), l = arg1[0].size(), n = arg2[0].size();
-    std::vector < lbcrypto::Ciphertext<lbcrypto::DCRTPoly> > ciphertextArg1, ciphertextArg2;
-    for (size_t i = 0; i < m; ++i){
-        lbcrypto::Plaintext plaintext = cryptoContext->MakeCKKSPackedPlaintext(arg1[i], 1, 0, nullptr, l);
-        ciphertextArg1.push_back(cryptoContext->Encrypt(keyPair.publicKey, plaintext));
-    }
-    for (size_t j = 0; j < n; ++j){
-        std::vector <double> temp;
-        for (size_t i = 0; i < l; ++i)
-            temp.push_back(arg2[i][j]);
-        lbcrypto::Plaintext plaintext = cryptoContext->MakeCKKSPackedPlaintext(temp, 1, 0, nullptr, l);
-        ciphertextArg2.push_back(cryptoContext->Encrypt(keyPair.publicKey, plaintext));
-    }
-
-    std::vector < std::vector <double> > res(m, std::vector<double>(n));
-    auto encryptedRes = helper(cryptoContext, ciphertextArg1, ciphertextArg2, m, l, n);
-    for (size_t i = 0; i < m; ++i){
-        for (size_t j = 0; j < n; ++j){
-            double sum = 0;
-            Plaintext plaintextJ;
-            cryptoContext->Decrypt(keyPair.secretKey, encryptedRes[i][j], &plaintextJ);
-            for (size_t k = 0; k < l; ++k){
-                sum += plaintextJ->GetRealPackedValue()[k];
-            }
-            res[i][j] = sum;
-        }
-    }
-
-    return res;
-}
-
-signed main(){
-
-    CCParams<CryptoContextBGVRNS> BGVParams;
-    BGVParams.SetMultiplicativeDepth(3);
-    BGVParams.SetPlaintextModulus(65537);
+signed main(int argc, char *argv[]){
+    if (argc > 1)
+        batch::SetThreadCount(std::stoul(argv[1]));
+    // a memory budget in MiB switches to the streaming pipeline
+    size_t memoryBudget = argc > 2 ? std::stoul(argv[2]) << 20 : 0;
+    // "empirical" times the candidate parameter sets instead of taking the analytic choice
+    bool empirical = argc > 3 && std::string(argv[3]) == "empirical";
+
+    // one packed row of arg1 repeated per column of arg2, multiplied and summed over l slots
+    tuner::Workload workload;
+    workload.ops = {{tuner::MULT}, {tuner::SUM, static_cast<uint32_t>(vectorA[0].size())}};
+    workload.vectorLength = vectorB[0].size() * nextPowerOfTwo(vectorA[0].size());
+    workload.maxInput = 100;
+
+    auto BGVParams = empirical ? tuner::TuneEmpirical<CryptoContextBGVRNS>(workload) : tuner::Tune<CryptoContextBGVRNS>(workload);
     auto BGVContext = GenCryptoContext(BGVParams);
     BGVContext->Enable(PKE);
     BGVContext->Enable(KEYSWITCH);
     BGVContext->Enable(LEVELEDSHE);
     BGVContext->Enable(ADVANCEDSHE);
 
-    CCParams<CryptoContextBFVRNS> BFVParams;
-    BFVParams.SetMultiplicativeDepth(3);
-    BFVParams.SetPlaintextModulus(65537);
+    auto BFVParams = empirical ? tuner::TuneEmpirical<CryptoContextBFVRNS>(workload) : tuner::Tune<CryptoContextBFVRNS>(workload);
     auto BFVContext = GenCryptoContext(BFVParams);
     BFVContext->Enable(PKE);
     BFVContext->Enable(KEYSWITCH);
     BFVContext->Enable(LEVELEDSHE);
     BFVContext->Enable(ADVANCEDSHE);
 
-    CCParams<CryptoContextCKKSRNS> CKKSParams;
-    CKKSParams.SetMultiplicativeDepth(3);
-    CKKSParams.SetScalingModSize(50);
-    CKKSParams.SetBatchSize(8);
+    auto CKKSParams = empirical ? tuner::TuneEmpirical<CryptoContextCKKSRNS>(workload) : tuner::Tune<CryptoContextCKKSRNS>(workload);
     auto CKKSContext = GenCryptoContext(CKKSParams);
     CKKSContext->Enable(PKE);
     CKKSContext->Enable(KEYSWITCH);
@@ -277,8 +211,12 @@ signed main(){
     BFVContext->EvalMultKeyGen(BFVKeypair.secretKey);
     CKKSContext->EvalMultKeyGen(CKKSKeypair.secretKey);
 
+    BGVContext->EvalRotateKeyGen(BGVKeypair.secretKey, reduceIndices(vectorA[0].size()));
+    BFVContext->EvalRotateKeyGen(BFVKeypair.secretKey, reduceIndices(vectorA[0].size()));
+    CKKSContext->EvalRotateKeyGen(CKKSKeypair.secretKey, reduceIndices(vectorC[0].size()));
+
     {
-        auto BGVmulABresult = multiply(BGVContext, BGVKeypair, vectorA, vectorB);
+        auto BGVmulABresult = memoryBudget ? multiplyStreaming(BGVContext, BGVKeypair, vectorA, vectorB, memoryBudget) : multiply(BGVContext, BGVKeypair, vectorA, vectorB);
         for (auto i: BGVmulABresult){
             for (auto j: i){
                 std::cout << j << ' ';
@@ -286,7 +224,7 @@ signed main(){
             std::cout << std::endl;
         }
 
-        auto BFVmulABresult = multiply(BFVContext, BFVKeypair, vectorA, vectorB);
+        auto BFVmulABresult = memoryBudget ? multiplyStreaming(BFVContext, BFVKeypair, vectorA, vectorB, memoryBudget) : multiply(BFVContext, BFVKeypair, vectorA, vectorB);
         for (auto i: BFVmulABresult){
             for (auto j: i){
                 std::cout << j << ' ';
@@ -294,7 +232,7 @@ signed main(){
             std::cout << std::endl;
         }
 
-        auto CKKSmulCDresult = multiply(CKKSContext, CKKSKeypair, vectorC, vectorD);
+        auto CKKSmulCDresult = memoryBudget ? multiplyStreaming(CKKSContext, CKKSKeypair, vectorC, vectorD, memoryBudget) : multiply(CKKSContext, CKKSKeypair, vectorC, vectorD);
         for (auto i: CKKSmulCDresult){
             for (auto j: i){
                 std::cout << j << ' ';
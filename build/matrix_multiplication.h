@@ -0,0 +1,382 @@
+#pragma once
+
+#include <openfhe.h>
+#include "batch.h"
+#include "pipeline.h"
+#include "planner.h"
+#include <omp.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace matmul {
+
+using namespace lbcrypto;
+
+inline size_t nextPowerOfTwo(size_t x){
+    size_t res = 1;
+    while (res < x)
+        res <<= 1;
+    return res;
+}
+
+inline size_t slotCount(CryptoContext<DCRTPoly> cryptoContext){
+    size_t batchSize = cryptoContext->GetEncodingParams()->GetBatchSize();
+    size_t half = cryptoContext->GetRingDimension() / 2;
+    return (batchSize == 0 || batchSize > half) ? half : batchSize;
+}
+
+// Block packing of an m x l by l x n product: every ciphertext holds rowsPerCt rows of arg1,
+// each repeated n times, next to arg2 column-major. Slot ((r * n + j) * width + k) carries the
+// k-th term of the dot product of row r and column j, and the inner dimension is split into
+// chunks of width slots whenever n * l does not fit in one ciphertext.
+struct Layout {
+    size_t m, l, n;
+    size_t width, chunks, rowsPerCt, groups;
+};
+
+template <typename T>
+double maxAbs(const std::vector < std::vector <T> > &arg){
+    double res = 0;
+    for (const auto &row: arg)
+        for (auto x: row)
+            res = std::max(res, std::abs(static_cast<double>(x)));
+    return res;
+}
+
+// The dot products are summed under encryption, so under BGV/BFV each of them has to stay
+// within t/2 of zero; a bound of l * max|arg1| * max|arg2| that does not is rejected.
+inline void checkRange(CryptoContext<DCRTPoly> cryptoContext, size_t l, double maxArg1, double maxArg2){
+    if (cryptoContext->getSchemeId() == CKKSRNS_SCHEME)
+        return;
+    double range = l * maxArg1 * maxArg2;
+    uint64_t plaintextModulus = cryptoContext->GetEncodingParams()->GetPlaintextModulus();
+    if (range > (plaintextModulus - 1) / 2)
+        throw std::invalid_argument("dot products up to " + std::to_string(range) + " do not fit plaintext modulus " + std::to_string(plaintextModulus));
+}
+
+inline Layout makeLayout(CryptoContext<DCRTPoly> cryptoContext, size_t m, size_t l, size_t n, double maxArg1, double maxArg2){
+    checkRange(cryptoContext, l, maxArg1, maxArg2);
+    size_t slots = slotCount(cryptoContext);
+    if (n > slots)
+        throw std::invalid_argument("matrix has more columns than the ciphertext has slots");
+    size_t width = nextPowerOfTwo(l);
+    while (n * width > slots)
+        width >>= 1;
+    Layout layout;
+    layout.m = m;
+    layout.l = l;
+    layout.n = n;
+    layout.width = width;
+    layout.chunks = (l + width - 1) / width;
+    layout.rowsPerCt = std::min(m, slots / (n * width));
+    layout.groups = (m + layout.rowsPerCt - 1) / layout.rowsPerCt;
+    return layout;
+}
+
+inline std::vector <int32_t> reduceIndices(size_t l){
+    std::vector <int32_t> res;
+    for (size_t step = 1; step < nextPowerOfTwo(l); step <<= 1)
+        res.push_back(step);
+    return res;
+}
+
+// slot vectors for the chunks of row group g; row(i) returns row i of arg1
+template <typename T, typename Row>
+std::vector < std::vector <T> > packGroup(Row row, const Layout &layout, size_t g){
+    std::vector < std::vector <T> > rows;
+    for (size_t r = 0; r < layout.rowsPerCt && g * layout.rowsPerCt + r < layout.m; ++r)
+        rows.push_back(row(g * layout.rowsPerCt + r));
+    std::vector < std::vector <T> > res(layout.chunks);
+    for (size_t c = 0; c < layout.chunks; ++c){
+        std::vector <T> &slots = res[c];
+        slots.assign(layout.rowsPerCt * layout.n * layout.width, 0);
+        for (size_t r = 0; r < rows.size(); ++r)
+            for (size_t j = 0; j < layout.n; ++j)
+                for (size_t k = 0; k < layout.width && c * layout.width + k < layout.l; ++k)
+                    slots[(r * layout.n + j) * layout.width + k] = rows[r][c * layout.width + k];
+    }
+    return res;
+}
+
+template <typename T>
+std::vector < std::vector < std::vector <T> > > packRows(const std::vector < std::vector <T> > &arg, const Layout &layout){
+    std::vector < std::vector < std::vector <T> > > res;
+    for (size_t g = 0; g < layout.groups; ++g)
+        res.push_back(packGroup<T>([&arg](size_t i) -> const std::vector <T> & { return arg[i]; }, layout, g));
+    return res;
+}
+
+template <typename T>
+std::vector < std::vector <T> > packColumns(const std::vector < std::vector <T> > &arg, const Layout &layout){
+    std::vector < std::vector <T> > res(layout.chunks);
+    for (size_t c = 0; c < layout.chunks; ++c){
+        std::vector <T> &slots = res[c];
+        slots.assign(layout.rowsPerCt * layout.n * layout.width, 0);
+        for (size_t r = 0; r < layout.rowsPerCt; ++r)
+            for (size_t j = 0; j < layout.n; ++j)
+                for (size_t k = 0; k < layout.width && c * layout.width + k < layout.l; ++k)
+                    slots[(r * layout.n + j) * layout.width + k] = arg[c * layout.width + k][j];
+    }
+    return res;
+}
+
+// sums every block of width consecutive slots into the first slot of the block
+inline Ciphertext<DCRTPoly> reduce(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> arg, size_t width){
+    for (size_t step = 1; step < width; step <<= 1)
+        arg = cryptoContext->EvalAdd(arg, cryptoContext->EvalRotate(arg, step));
+    return arg;
+}
+
+inline std::vector < Ciphertext<DCRTPoly> > helper(CryptoContext<DCRTPoly> cryptoContext, std::vector < std::vector < Ciphertext<DCRTPoly> > > arg1, std::vector < Ciphertext<DCRTPoly> > arg2, const Layout &layout){
+    std::vector <planner::SumOfProducts> exprs(layout.groups);
+    for (size_t g = 0; g < layout.groups; ++g)
+        for (size_t c = 0; c < layout.chunks; ++c)
+            exprs[g].Add(arg1[g][c], arg2[c]);
+
+    std::vector < Ciphertext<DCRTPoly> > res(layout.groups);
+    batch::ParallelFor(layout.groups, [&](size_t g){
+        res[g] = reduce(cryptoContext, planner::Evaluate(cryptoContext, exprs[g]), layout.width);
+    });
+    return res;
+}
+
+inline std::vector < std::vector <int64_t> > multiply(CryptoContext<DCRTPoly> cryptoContext, KeyPair<DCRTPoly> keyPair, std::vector < std::vector <int64_t> > arg1, std::vector < std::vector <int64_t> > arg2){
+    size_t m = arg1.size(), l = arg1[0].size(), n = arg2[0].size();
+    auto layout = makeLayout(cryptoContext, m, l, n, maxAbs(arg1), maxAbs(arg2));
+    auto rows = packRows(arg1, layout);
+    auto columns = packColumns(arg2, layout);
+    std::vector <Plaintext> plaintexts;
+    for (size_t g = 0; g < layout.groups; ++g)
+        for (size_t c = 0; c < layout.chunks; ++c)
+            plaintexts.push_back(cryptoContext->MakePackedPlaintext(rows[g][c]));
+    for (size_t c = 0; c < layout.chunks; ++c)
+        plaintexts.push_back(cryptoContext->MakePackedPlaintext(columns[c]));
+    auto ciphertexts = batch::EncryptMany(cryptoContext, keyPair.publicKey, plaintexts);
+
+    std::vector < std::vector < Ciphertext<DCRTPoly> > > ciphertextArg1(layout.groups);
+    for (size_t g = 0; g < layout.groups; ++g)
+        ciphertextArg1[g].assign(ciphertexts.begin() + g * layout.chunks, ciphertexts.begin() + (g + 1) * layout.chunks);
+    std::vector < Ciphertext<DCRTPoly> > ciphertextArg2(ciphertexts.end() - layout.chunks, ciphertexts.end());
+
+    std::vector < std::vector <int64_t> > res(m, std::vector<int64_t>(n));
+    auto encryptedRes = helper(cryptoContext, ciphertextArg1, ciphertextArg2, layout);
+    auto decryptedRes = batch::DecryptMany(cryptoContext, keyPair.secretKey, encryptedRes);
+    for (size_t g = 0; g < layout.groups; ++g){
+        const auto &values = decryptedRes[g]->GetPackedValue();
+        for (size_t r = 0; r < layout.rowsPerCt && g * layout.rowsPerCt + r < m; ++r)
+            for (size_t j = 0; j < n; ++j)
+                res[g * layout.rowsPerCt + r][j] = values[(r * n + j) * layout.width];
+    }
+
+    return res;
+}
+
+inline std::vector < std::vector <double> > multiply(CryptoContext<DCRTPoly> cryptoContext, KeyPair<DCRTPoly> keyPair, std::vector < std::vector <double> > arg1, std::vector < std::vector <double> > arg2){
+    size_t m = arg1.size(), l = arg1[0].size(), n = arg2[0].size();
+    auto layout = makeLayout(cryptoContext, m, l, n, maxAbs(arg1), maxAbs(arg2));
+    auto rows = packRows(arg1, layout);
+    auto columns = packColumns(arg2, layout);
+    std::vector <Plaintext> plaintexts;
+    for (size_t g = 0; g < layout.groups; ++g)
+        for (size_t c = 0; c < layout.chunks; ++c)
+            plaintexts.push_back(cryptoContext->MakeCKKSPackedPlaintext(rows[g][c]));
+    for (size_t c = 0; c < layout.chunks; ++c)
+        plaintexts.push_back(cryptoContext->MakeCKKSPackedPlaintext(columns[c]));
+    auto ciphertexts = batch::EncryptMany(cryptoContext, keyPair.publicKey, plaintexts);
+
+    std::vector < std::vector < Ciphertext<DCRTPoly> > > ciphertextArg1(layout.groups);
+    for (size_t g = 0; g < layout.groups; ++g)
+        ciphertextArg1[g].assign(ciphertexts.begin() + g * layout.chunks, ciphertexts.begin() + (g + 1) * layout.chunks);
+    std::vector < Ciphertext<DCRTPoly> > ciphertextArg2(ciphertexts.end() - layout.chunks, ciphertexts.end());
+
+    std::vector < std::vector <double> > res(m, std::vector<double>(n));
+    auto encryptedRes = helper(cryptoContext, ciphertextArg1, ciphertextArg2, layout);
+    auto decryptedRes = batch::DecryptMany(cryptoContext, keyPair.secretKey, encryptedRes);
+    for (size_t g = 0; g < layout.groups; ++g){
+        const auto &values = decryptedRes[g]->GetRealPackedValue();
+        for (size_t r = 0; r < layout.rowsPerCt && g * layout.rowsPerCt + r < m; ++r)
+            for (size_t j = 0; j < n; ++j)
+                res[g * layout.rowsPerCt + r][j] = values[(r * n + j) * layout.width];
+    }
+
+    return res;
+}
+
+inline Plaintext encode(CryptoContext<DCRTPoly> cryptoContext, const std::vector <int64_t> &slots){
+    return cryptoContext->MakePackedPlaintext(slots);
+}
+
+inline Plaintext encode(CryptoContext<DCRTPoly> cryptoContext, const std::vector <double> &slots){
+    return cryptoContext->MakeCKKSPackedPlaintext(slots);
+}
+
+inline void decode(Plaintext plaintext, std::vector <int64_t> &values){
+    values = plaintext->GetPackedValue();
+}
+
+inline void decode(Plaintext plaintext, std::vector <double> &values){
+    values = plaintext->GetRealPackedValue();
+}
+
+inline size_t ciphertextBytes(Ciphertext<DCRTPoly> ciphertext){
+    const auto &elements = ciphertext->GetElements();
+    return elements.size() * elements[0].GetNumOfElements() * elements[0].GetRingDimension() * sizeof(uint64_t);
+}
+
+// hybrid key switching of one ciphertext holds dnum digits over the extended Q*P basis plus
+// the two accumulators over the same basis
+inline size_t keySwitchBytes(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> ciphertext){
+    const auto &element = ciphertext->GetElements()[0];
+    auto cryptoParams = std::dynamic_pointer_cast<CryptoParametersRNS>(cryptoContext->GetCryptoParameters());
+    size_t digits = std::max<size_t>(cryptoParams->GetNumPartQ(), 1);
+    size_t towersP = cryptoParams->GetParamsP() ? cryptoParams->GetParamsP()->GetParams().size() : 0;
+    return (digits + 2) * (element.GetNumOfElements() + towersP) * element.GetRingDimension() * sizeof(uint64_t);
+}
+
+// Pipelined product for arg1 too large to keep encrypted at once. One thread encodes and
+// encrypts row groups of arg1 (fetched through row), worker threads evaluate them and a
+// decrypt stage on the calling thread hands finished rows to sink, in completion order.
+// The stages are joined by bounded queues sized so that the estimated peak stays under
+// memoryBudget bytes: the arg2 ciphertexts, the queued tiles, and in every stage its
+// plaintexts, the degree-2 sum, rotation temporaries and key-switching scratch over Q*P.
+// Evaluation keys and OpenFHE's precomputed tables are not counted. OpenFHE's own threads
+// are split between the stages so that together they use batch::GetThreadCount() cores.
+template <typename T>
+void multiplyStreaming(CryptoContext<DCRTPoly> cryptoContext, KeyPair<DCRTPoly> keyPair, size_t m, std::function < std::vector <T>(size_t) > row, const std::vector < std::vector <T> > &arg2, size_t memoryBudget, std::function < void(size_t, std::vector <T>) > sink){
+    size_t l = arg2.size(), n = arg2[0].size();
+    // arg1 is only seen row group by row group, so its range is checked as it is encrypted
+    double maxArg2 = maxAbs(arg2);
+    auto layout = makeLayout(cryptoContext, m, l, n, 0, maxArg2);
+    auto columns = packColumns(arg2, layout);
+    std::vector < Ciphertext<DCRTPoly> > ciphertextArg2;
+    for (size_t c = 0; c < layout.chunks; ++c)
+        ciphertextArg2.push_back(cryptoContext->Encrypt(keyPair.publicKey, encode(cryptoContext, columns[c])));
+
+    // a plaintext is one polynomial at the ciphertext's level, a slot vector is small next
+    // to it; the degree-2 sum is 1.5 ciphertexts and reduce() keeps the running sum and one
+    // rotation alive
+    size_t bytes = ciphertextBytes(ciphertextArg2[0]);
+    size_t scratch = keySwitchBytes(cryptoContext, ciphertextArg2[0]);
+    size_t slotBytes = layout.rowsPerCt * layout.n * layout.width * sizeof(T);
+    size_t fixed = layout.chunks * bytes;
+    size_t encryptedTile = layout.chunks * bytes;
+    size_t encryptStage = encryptedTile + layout.chunks * (bytes / 2 + slotBytes) + bytes;
+    size_t worker = encryptedTile + bytes * 3 / 2 + 2 * bytes + scratch;
+    size_t decryptStage = bytes + bytes / 2 + slotBytes;
+    size_t minimum = fixed + encryptStage + decryptStage + worker + encryptedTile + bytes;
+    if (memoryBudget < minimum)
+        throw std::invalid_argument("memory budget of " + std::to_string(memoryBudget) + " bytes is below the " + std::to_string(minimum) + " bytes the pipeline needs");
+    size_t spare = memoryBudget - minimum;
+    size_t threads = batch::GetThreadCount();
+    size_t workers = 1 + std::min(threads - 1, spare / 2 / worker);
+    spare -= (workers - 1) * worker;
+    size_t encryptedCapacity = 1 + spare / 2 / encryptedTile;
+    size_t evaluatedCapacity = 1 + (spare - (encryptedCapacity - 1) * encryptedTile) / bytes;
+    int internalThreads = std::max<size_t>(1, threads / (workers + 2));
+
+    pipeline::BoundedQueue < std::pair < size_t, std::vector < Ciphertext<DCRTPoly> > > > encrypted(encryptedCapacity);
+    pipeline::BoundedQueue < std::pair < size_t, Ciphertext<DCRTPoly> > > evaluated(evaluatedCapacity);
+    std::atomic <bool> failed(false);
+    std::atomic <size_t> activeWorkers(workers);
+    std::exception_ptr error = nullptr;
+    std::mutex errorMutex;
+    auto fail = [&](){
+        {
+            std::lock_guard <std::mutex> lock(errorMutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        failed = true;
+        encrypted.Close();
+        evaluated.Close();
+    };
+
+    std::vector <std::thread> stages;
+    stages.emplace_back([&](){
+        omp_set_num_threads(internalThreads);
+        try {
+            for (size_t g = 0; g < layout.groups && !failed; ++g){
+                auto slots = packGroup<T>(row, layout, g);
+                checkRange(cryptoContext, l, maxAbs(slots), maxArg2);
+                std::vector < Ciphertext<DCRTPoly> > tile;
+                for (size_t c = 0; c < layout.chunks; ++c)
+                    tile.push_back(cryptoContext->Encrypt(keyPair.publicKey, encode(cryptoContext, slots[c])));
+                if (!encrypted.Push({g, std::move(tile)}))
+                    break;
+            }
+        }
+        catch (...){
+            fail();
+        }
+        encrypted.Close();
+    });
+    for (size_t w = 0; w < workers; ++w){
+        stages.emplace_back([&](){
+            omp_set_num_threads(internalThreads);
+            try {
+                while (auto tile = encrypted.Pop()){
+                    if (failed)
+                        break;
+                    planner::SumOfProducts expr;
+                    for (size_t c = 0; c < layout.chunks; ++c)
+                        expr.Add(tile->second[c], ciphertextArg2[c]);
+                    auto res = reduce(cryptoContext, planner::Evaluate(cryptoContext, expr), layout.width);
+                    if (!evaluated.Push({tile->first, res}))
+                        break;
+                }
+            }
+            catch (...){
+                fail();
+            }
+            if (--activeWorkers == 0)
+                evaluated.Close();
+        });
+    }
+
+    int callerThreads = omp_get_max_threads();
+    omp_set_num_threads(internalThreads);
+    try {
+        while (auto result = evaluated.Pop()){
+            if (failed)
+                break;
+            Plaintext plaintext;
+            cryptoContext->Decrypt(keyPair.secretKey, result->second, &plaintext);
+            std::vector <T> values;
+            decode(plaintext, values);
+            size_t g = result->first;
+            for (size_t r = 0; r < layout.rowsPerCt && g * layout.rowsPerCt + r < m; ++r){
+                std::vector <T> resRow(n);
+                for (size_t j = 0; j < n; ++j)
+                    resRow[j] = values[(r * n + j) * layout.width];
+                sink(g * layout.rowsPerCt + r, std::move(resRow));
+            }
+        }
+    }
+    catch (...){
+        fail();
+    }
+
+    omp_set_num_threads(callerThreads);
+    for (auto &stage: stages)
+        stage.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+template <typename T>
+std::vector < std::vector <T> > multiplyStreaming(CryptoContext<DCRTPoly> cryptoContext, KeyPair<DCRTPoly> keyPair, const std::vector < std::vector <T> > &arg1, const std::vector < std::vector <T> > &arg2, size_t memoryBudget){
+    std::vector < std::vector <T> > res(arg1.size());
+    multiplyStreaming<T>(cryptoContext, keyPair, arg1.size(), [&arg1](size_t i){ return arg1[i]; }, arg2, memoryBudget, [&res](size_t i, std::vector <T> resRow){ res[i] = std::move(resRow); });
+    return res;
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace pipeline {
+
+// Blocking queue between pipeline stages. Push waits while the queue is full, which is
+// what caps the number of live ciphertexts; Close wakes every waiter, after which Push
+// fails and Pop drains what is left before returning nothing.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    bool Push(T value){
+        std::unique_lock <std::mutex> lock(mutex);
+        notFull.wait(lock, [this](){ return closed || items.size() < capacity; });
+        if (closed)
+            return false;
+        items.push_back(std::move(value));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    std::optional<T> Pop(){
+        std::unique_lock <std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this](){ return closed || !items.empty(); });
+        if (items.empty())
+            return std::nullopt;
+        T value = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return value;
+    }
+
+    void Close(){
+        std::lock_guard <std::mutex> lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    bool closed = false;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+};
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <openfhe.h>
+#include "levels.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Deferred relinearization for multiply-accumulate. Every output is described as a sum of
+// products; its terms are multiplied with EvalMultNoRelin and accumulated as degree-2
+// ciphertexts, and the sum is relinearized once, so an l-term dot product costs one key
+// switch instead of l. Under FIXEDMANUAL the operands are first brought to a common level
+// and the sum is rescaled once; the automatic techniques do both inside OpenFHE, and the
+// single pending rescale happens on the next multiplication.
+//
+// In the block-packed matrix product there is one term per chunk of the inner dimension, so
+// this only saves key switches once l no longer fits next to n in one ciphertext; the
+// log2(width) rotations of matmul::reduce are the key switches left on that path.
+namespace planner {
+
+using namespace lbcrypto;
+
+class SumOfProducts {
+public:
+    void Add(Ciphertext<DCRTPoly> a, Ciphertext<DCRTPoly> b){
+        terms.emplace_back(a, b);
+    }
+
+    const std::vector < std::pair < Ciphertext<DCRTPoly>, Ciphertext<DCRTPoly> > > &Terms() const {
+        return terms;
+    }
+
+private:
+    std::vector < std::pair < Ciphertext<DCRTPoly>, Ciphertext<DCRTPoly> > > terms;
+};
+
+inline Ciphertext<DCRTPoly> Evaluate(CryptoContext<DCRTPoly> cryptoContext, const SumOfProducts &expr){
+    auto terms = expr.Terms();
+    if (terms.empty())
+        throw std::invalid_argument("sum of products has no terms");
+
+    bool manual = levels::manualRescale(cryptoContext);
+    if (manual){
+        size_t level = 0;
+        for (const auto &term: terms)
+            level = std::max({level, term.first->GetLevel(), term.second->GetLevel()});
+        for (auto &term: terms){
+            if (term.first->GetLevel() < level)
+                term.first = cryptoContext->LevelReduce(term.first, nullptr, level - term.first->GetLevel());
+            if (term.second->GetLevel() < level)
+                term.second = cryptoContext->LevelReduce(term.second, nullptr, level - term.second->GetLevel());
+        }
+    }
+
+    auto sum = cryptoContext->EvalMultNoRelin(terms[0].first, terms[0].second);
+    for (size_t i = 1; i < terms.size(); ++i)
+        cryptoContext->EvalAddInPlace(sum, cryptoContext->EvalMultNoRelin(terms[i].first, terms[i].second));
+    sum = cryptoContext->Relinearize(sum);
+    return manual ? cryptoContext->Rescale(sum) : sum;
+}
+
+}
@@ -1,66 +1,52 @@
 #include <openfhe.h>
+#include "relu.h"
 #include <vector>
 
 using namespace lbcrypto;
 
-signed main(){
+signed main(int argc, char *argv[]){
 
-    auto scalingTechnique = FIXEDMANUAL;
-    int64_t multiplicativeDepth = 17;
-    int64_t firstModSize = 60;
-    int64_t scalingModSize = 50;
-    int64_t ringDim = 8192;
-    auto securityLevel = HEStd_NotSet;
-    auto slBin = TOY;
-    int64_t logQ_ccLWE = 23;
-    int64_t slots = 16;
-    int64_t batchSize = 16;
+    std::string storeDir = argc > 1 ? argv[1] : "relu-keys";
 
-    CCParams<CryptoContextCKKSRNS> CKKSParams;
-    CKKSParams.SetMultiplicativeDepth(multiplicativeDepth);
-    CKKSParams.SetFirstModSize(firstModSize);
-    CKKSParams.SetScalingModSize(scalingModSize);
-    CKKSParams.SetScalingTechnique(scalingTechnique);
-    CKKSParams.SetSecurityLevel(securityLevel);
-    CKKSParams.SetRingDim(ringDim);
-    CKKSParams.SetBatchSize(batchSize);
-    auto CKKSContext = GenCryptoContext(CKKSParams);
-    CKKSContext->Enable(PKE);
-    CKKSContext->Enable(KEYSWITCH);
-    CKKSContext->Enable(LEVELEDSHE);
-    CKKSContext->Enable(ADVANCEDSHE);
-    CKKSContext->Enable(SCHEMESWITCH);
-    CKKSContext->Enable(PRE);
-
-    auto CKKSKeypair = CKKSContext->KeyGen();
-    SchSwchParams switchParams;
-    switchParams.SetSecurityLevelCKKS(securityLevel);
-    switchParams.SetSecurityLevelFHEW(slBin);
-    switchParams.SetCtxtModSizeFHEWLargePrec(logQ_ccLWE);
-    switchParams.SetNumSlotsCKKS(slots);
-    auto privateKeyFHEW = CKKSContext->EvalCKKStoFHEWSetup(switchParams);
-    auto ccLWE          = CKKSContext->GetBinCCForSchemeSwitch();
-    CKKSContext->EvalCKKStoFHEWKeyGen(CKKSKeypair, privateKeyFHEW);
-
-    // double scaleSign = 256;
-    // auto modulus_LWE = 1 << logQ_ccLWE;
-    // auto beta = ccLWE.GetBeta();
-    // auto pLWE = modulus_LWE / 2 / beta;
-
-    CKKSContext->EvalCompareSwitchPrecompute(0, 1, false);
-
-    CKKSContext->EvalSumKeyGen(CKKSKeypair.secretKey, CKKSKeypair.publicKey);
-    CKKSContext->EvalMultKeyGen(CKKSKeypair.secretKey);
+    auto store = relu::schemeSwitchingContext(storeDir);
+    auto CKKSContext = store.cryptoContext;
+    auto CKKSKeypair = store.keyPair;
+    uint32_t slots = relu::SLOTS;
     
     std::vector <double> vec = {91, 140, 204, 50, 70, 129, 98, 57, 91, 140, 204, 50, 70, 129, 52, 52};
+    for (auto &x: vec)
+        x -= 128;
     auto plaintextVec = CKKSContext->MakeCKKSPackedPlaintext(vec);
     auto ciphertextVec = CKKSContext->Encrypt(CKKSKeypair.publicKey, plaintextVec);
 
-    auto result = CKKSContext->EvalMinSchemeSwitching(ciphertextVec, CKKSKeypair.publicKey, 16, slots, false);
-    Plaintext res1, res2;
-    CKKSContext->Decrypt(CKKSKeypair.secretKey, result[0], &res1);
-    CKKSContext->Decrypt(CKKSKeypair.secretKey, result[1], &res2);
-    std::cout << res1 << ' ' << res2 << std::endl;
+    auto print = [&](Ciphertext<DCRTPoly> ciphertext){
+        Plaintext plaintext;
+        CKKSContext->Decrypt(CKKSKeypair.secretKey, ciphertext, &plaintext);
+        plaintext->SetLength(slots);
+        std::cout << plaintext << std::endl;
+    };
+
+    relu::ComparisonOptions exact;
+    exact.backend = relu::SCHEME_SWITCHING;
+    exact.bound = 128;
+    print(relu::ReLU(CKKSContext, ciphertextVec, exact));
+
+    // the polynomial only resolves values at least gap away from zero within the levels
+    // available, so it gets data that keeps that distance
+    std::vector <double> far = {-96, 64, 32, -32, -64, 96, 40, -40, 120, -120, 48, -48, 80, -80, 33, -33};
+    auto ciphertextFar = CKKSContext->Encrypt(CKKSKeypair.publicKey, CKKSContext->MakeCKKSPackedPlaintext(far));
+    relu::ComparisonOptions approximate;
+    approximate.backend = relu::POLYNOMIAL;
+    approximate.bound = 128;
+    approximate.gap = 32;
+    approximate.precisionBits = 4;
+    print(relu::ReLU(CKKSContext, ciphertextFar, approximate));
+
+    // 2x2 max-pool of the 4x4 image in vec; the rotations by 1 and 4 are covered by the EvalSum keys
+    relu::ComparisonOptions pooling;
+    pooling.backend = relu::AUTO;
+    pooling.bound = 128;
+    print(relu::maxPool(CKKSContext, ciphertextVec, 2, 4, pooling));
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <openfhe.h>
+#include "keystore.h"
+#include "levels.h"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace relu {
+
+using namespace lbcrypto;
+
+constexpr uint32_t SLOTS = 16;
+
+// depth-17 CKKS context with CKKS<->FHEW scheme switching, loaded from storeDir when a
+// store exists there and generated and saved to it otherwise
+inline keystore::Store schemeSwitchingContext(const std::string &storeDir){
+    auto scalingTechnique = FIXEDMANUAL;
+    int64_t multiplicativeDepth = 17;
+    int64_t firstModSize = 60;
+    int64_t scalingModSize = 50;
+    int64_t ringDim = 8192;
+    auto securityLevel = HEStd_NotSet;
+    auto slBin = TOY;
+    int64_t logQ_ccLWE = 23;
+
+    CryptoContext<DCRTPoly> CKKSContext;
+    KeyPair<DCRTPoly> CKKSKeypair;
+    if (keystore::Exists(storeDir)){
+        auto store = keystore::Load(storeDir);
+        CKKSContext = store.cryptoContext;
+        CKKSKeypair = store.keyPair;
+        keystore::LoadAllRotationKeys(storeDir, CKKSContext, CKKSKeypair.publicKey->GetKeyTag());
+        keystore::LoadSchemeSwitch(storeDir, CKKSContext);
+    }
+    else {
+        CCParams<CryptoContextCKKSRNS> CKKSParams;
+        CKKSParams.SetMultiplicativeDepth(multiplicativeDepth);
+        CKKSParams.SetFirstModSize(firstModSize);
+        CKKSParams.SetScalingModSize(scalingModSize);
+        CKKSParams.SetScalingTechnique(scalingTechnique);
+        CKKSParams.SetSecurityLevel(securityLevel);
+        CKKSParams.SetRingDim(ringDim);
+        CKKSParams.SetBatchSize(SLOTS);
+        CKKSContext = GenCryptoContext(CKKSParams);
+        CKKSContext->Enable(PKE);
+        CKKSContext->Enable(KEYSWITCH);
+        CKKSContext->Enable(LEVELEDSHE);
+        CKKSContext->Enable(ADVANCEDSHE);
+        CKKSContext->Enable(SCHEMESWITCH);
+        CKKSContext->Enable(PRE);
+
+        CKKSKeypair = CKKSContext->KeyGen();
+        SchSwchParams switchParams;
+        switchParams.SetSecurityLevelCKKS(securityLevel);
+        switchParams.SetSecurityLevelFHEW(slBin);
+        switchParams.SetCtxtModSizeFHEWLargePrec(logQ_ccLWE);
+        switchParams.SetNumSlotsCKKS(SLOTS);
+        auto privateKeyFHEW = CKKSContext->EvalCKKStoFHEWSetup(switchParams);
+        CKKSContext->EvalCKKStoFHEWKeyGen(CKKSKeypair, privateKeyFHEW);
+
+        CKKSContext->EvalSumKeyGen(CKKSKeypair.secretKey, CKKSKeypair.publicKey);
+        CKKSContext->EvalMultKeyGen(CKKSKeypair.secretKey);
+
+        keystore::Save(storeDir, CKKSContext, CKKSKeypair, true);
+    }
+
+    // double scaleSign = 256;
+    // auto modulus_LWE = 1 << logQ_ccLWE;
+    // auto beta = ccLWE.GetBeta();
+    // auto pLWE = modulus_LWE / 2 / beta;
+
+    CKKSContext->EvalCompareSwitchPrecompute(0, 1, false);
+
+    return {CKKSContext, CKKSKeypair};
+}
+
+// Slot-wise ReLU and max-pool. Two comparison backends sit behind one API:
+//  SCHEME_SWITCHING  EvalCompareSchemeSwitching per slot through FHEW; exact for values the
+//                    EvalCompareSwitchPrecompute setting can represent, but costs one FHEW
+//                    bootstrapping per slot.
+//  POLYNOMIAL        stays in CKKS: sign(x) is approximated by composing
+//                    f(t) = (35t - 35t^3 + 21t^5 - 5t^7) / 16 on t = x / bound, which pushes
+//                    every |t| >= gap / bound towards +-1; 4 levels per composition.
+//  AUTO              POLYNOMIAL when enough compositions to reach precisionBits fit in the
+//                    levels the input has left, SCHEME_SWITCHING otherwise.
+enum Backend { SCHEME_SWITCHING, POLYNOMIAL, AUTO };
+
+struct ComparisonOptions {
+    Backend backend = AUTO;
+    double bound = 256;             // |x| <= bound in every slot
+    double gap = 1;                 // POLYNOMIAL: smallest |x| whose sign must meet precisionBits
+    double precisionBits = 8;       // POLYNOMIAL: |sign approximation - sign(x)| <= 2^-precisionBits
+    uint32_t numSlots = 0;          // SCHEME_SWITCHING: slots to compare, 0 for all the input holds
+    uint32_t setupSlots = SLOTS;    // SCHEME_SWITCHING: slots EvalCKKStoFHEWSetup was configured for
+};
+
+constexpr uint32_t SIGN_STAGE_DEPTH = 4;
+constexpr uint32_t MAX_SIGN_STAGES = 64;
+// the CKKS-to-FHEW linear transform and the final product with x
+constexpr uint32_t SCHEME_SWITCHING_DEPTH = 2;
+
+using levels::add;
+using levels::mult;
+using levels::remainingLevels;
+using levels::sub;
+
+inline double signStage(double t){
+    double t2 = t * t;
+    return t * (35 - t2 * (35 - t2 * (21 - 5 * t2))) / 16;
+}
+
+// compositions of signStage needed for precisionBits at |x| = gap, or MAX_SIGN_STAGES + 1
+inline uint32_t signStages(const ComparisonOptions &options){
+    double t = std::min(options.gap / options.bound, 1.0);
+    double target = std::pow(2, -options.precisionBits);
+    uint32_t stages = 0;
+    while (1 - t > target && stages <= MAX_SIGN_STAGES){
+        t = signStage(t);
+        ++stages;
+    }
+    return stages;
+}
+
+// normalization, the compositions, (1 + sign) / 2 and the final product with x
+inline size_t polynomialDepth(uint32_t stages){
+    return 1 + SIGN_STAGE_DEPTH * stages + 2;
+}
+
+inline Ciphertext<DCRTPoly> signStage(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> t){
+    auto t2 = mult(cryptoContext, t, t);
+    auto t3 = mult(cryptoContext, t2, t);
+    auto t4 = mult(cryptoContext, t2, t2);
+    auto t5 = mult(cryptoContext, t4, t);
+    auto t7 = mult(cryptoContext, t4, t3);
+    auto res = mult(cryptoContext, t, 35.0 / 16);
+    res = add(cryptoContext, res, mult(cryptoContext, t3, -35.0 / 16));
+    res = add(cryptoContext, res, mult(cryptoContext, t5, 21.0 / 16));
+    return add(cryptoContext, res, mult(cryptoContext, t7, -5.0 / 16));
+}
+
+// 1 where x >= 0 and 0 where x < 0, approximately
+inline Ciphertext<DCRTPoly> stepPolynomial(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> x, const ComparisonOptions &options){
+    auto t = mult(cryptoContext, x, 1 / options.bound);
+    for (uint32_t i = 0, stages = signStages(options); i < stages; ++i)
+        t = signStage(cryptoContext, t);
+    return cryptoContext->EvalAdd(mult(cryptoContext, t, 0.5), 0.5);
+}
+
+inline uint32_t compareSlots(Ciphertext<DCRTPoly> x, const ComparisonOptions &options){
+    return options.numSlots ? options.numSlots : x->GetSlots();
+}
+
+// 1 where x >= 0 and 0 where x < 0
+inline Ciphertext<DCRTPoly> stepSchemeSwitching(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> x, const ComparisonOptions &options){
+    uint32_t numSlots = compareSlots(x, options);
+    if (numSlots > options.setupSlots)
+        throw std::invalid_argument("scheme switching was set up for " + std::to_string(options.setupSlots) + " slots, comparing " + std::to_string(numSlots) + " would leave the rest uncompared");
+    auto zero = cryptoContext->EvalSub(x, x);
+    auto negative = cryptoContext->EvalCompareSchemeSwitching(x, zero, numSlots, numSlots);
+    return cryptoContext->EvalAdd(cryptoContext->EvalNegate(negative), 1.0);
+}
+
+// POLYNOMIAL is orders of magnitude cheaper than a FHEW bootstrapping per slot, so it wins
+// whenever it can meet the precision within the remaining levels. A backend that cannot run
+// on the levels x has left is an error rather than a silent fallback.
+inline Backend chooseBackend(Ciphertext<DCRTPoly> x, const ComparisonOptions &options){
+    uint32_t stages = signStages(options);
+    bool polynomial = stages <= MAX_SIGN_STAGES && polynomialDepth(stages) <= remainingLevels(x);
+    bool schemeSwitching = SCHEME_SWITCHING_DEPTH <= remainingLevels(x) && compareSlots(x, options) <= options.setupSlots;
+    if (options.backend == POLYNOMIAL && !polynomial)
+        throw std::invalid_argument("POLYNOMIAL comparison needs " + std::to_string(polynomialDepth(stages)) + " levels, the input has " + std::to_string(remainingLevels(x)));
+    if (options.backend == SCHEME_SWITCHING && !schemeSwitching)
+        throw std::invalid_argument("SCHEME_SWITCHING comparison needs " + std::to_string(SCHEME_SWITCHING_DEPTH) + " levels and at most " + std::to_string(options.setupSlots) + " slots, the input has " + std::to_string(remainingLevels(x)) + " levels and " + std::to_string(compareSlots(x, options)) + " slots");
+    if (options.backend != AUTO)
+        return options.backend;
+    if (polynomial)
+        return POLYNOMIAL;
+    if (schemeSwitching)
+        return SCHEME_SWITCHING;
+    throw std::invalid_argument("no comparison backend fits the " + std::to_string(remainingLevels(x)) + " levels and " + std::to_string(compareSlots(x, options)) + " slots of the input");
+}
+
+inline Ciphertext<DCRTPoly> ReLU(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> x, const ComparisonOptions &options){
+    auto step = chooseBackend(x, options) == POLYNOMIAL ? stepPolynomial(cryptoContext, x, options) : stepSchemeSwitching(cryptoContext, x, options);
+    return mult(cryptoContext, x, step);
+}
+
+// a and b within options.bound; their difference is compared against 2 * bound, since the
+// sign approximation diverges once |t| grows past about 1.5
+inline Ciphertext<DCRTPoly> max(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> a, Ciphertext<DCRTPoly> b, const ComparisonOptions &options){
+    auto differenceOptions = options;
+    differenceOptions.bound = 2 * options.bound;
+    return add(cryptoContext, b, ReLU(cryptoContext, sub(cryptoContext, a, b), differenceOptions));
+}
+
+// rotations used by maxPool; they must have rotation keys
+inline std::vector <int32_t> maxPoolIndices(uint32_t window, uint32_t width){
+    std::vector <int32_t> res;
+    for (uint32_t step = 1; step < window; step <<= 1){
+        res.push_back(step);
+        res.push_back(step * width);
+    }
+    return res;
+}
+
+// window x window max-pool over an image packed row-major with the given width; window must
+// be a power of two. Slot (i * width + j) ends up holding the maximum of the window whose
+// top-left corner is (i, j), so the pooled image sits at i and j multiples of window.
+// Every pixel must lie within options.bound; the maxima stay within it as well.
+inline Ciphertext<DCRTPoly> maxPool(CryptoContext<DCRTPoly> cryptoContext, Ciphertext<DCRTPoly> x, uint32_t window, uint32_t width, const ComparisonOptions &options){
+    for (uint32_t step = 1; step < window; step <<= 1)
+        x = max(cryptoContext, x, cryptoContext->EvalRotate(x, step), options);
+    for (uint32_t step = 1; step < window; step <<= 1)
+        x = max(cryptoContext, x, cryptoContext->EvalRotate(x, step * width), options);
+    return x;
+}
+
+}
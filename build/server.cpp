@@ -0,0 +1,70 @@
+#include <openfhe.h>
+#include "server.h"
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace lbcrypto;
+
+signed main(int argc, char *argv[]){
+
+    std::string storeDir = argc > 1 ? argv[1] : "server-keys";
+    std::string address = argc > 2 ? argv[2] : "unix:/tmp/openfhe-server.sock";
+    // with a client count, that many demo clients send their requests concurrently and the
+    // server exits once they are done; without one it serves until killed
+    size_t clients = argc > 3 ? std::stoul(argv[3]) : 0;
+
+    server::Options options;
+    auto store = server::evaluationContext(storeDir, options);
+    auto CKKSContext = store.cryptoContext;
+    auto CKKSKeypair = store.keyPair;
+
+    server::Server evaluator(CKKSContext, options);
+    evaluator.Listen(address);
+    if (clients == 0){
+        evaluator.Serve();
+        return 0;
+    }
+    std::thread serving([&](){ evaluator.Serve(); });
+
+    // encoded up front, since the encoding tables must not be built from several threads
+    std::vector <double> vectorB = {1.2, 1.0, 3.3, -1.1, 23.5};
+    std::vector <double> vectorC = {-4.0, -3.0, -2.0, -1.0, 0.0, 1.0, 2.0, 3.0, 4.0};
+    std::vector <Plaintext> plaintextsA;
+    for (size_t c = 0; c < clients; ++c)
+        plaintextsA.push_back(CKKSContext->MakeCKKSPackedPlaintext(std::vector <double>{1.5, -1.0, 1.333, 0.0, 16.0 + c}));
+    auto plaintextB = CKKSContext->MakeCKKSPackedPlaintext(vectorB);
+    auto plaintextC = CKKSContext->MakeCKKSPackedPlaintext(vectorC);
+
+    std::mutex printing;
+    std::vector <std::thread> threads;
+    for (size_t c = 0; c < clients; ++c){
+        threads.emplace_back([&, c](){
+            server::Client client(address);
+            auto ciphertextA = CKKSContext->Encrypt(CKKSKeypair.publicKey, plaintextsA[c]);
+            auto ciphertextB = CKKSContext->Encrypt(CKKSKeypair.publicKey, plaintextB);
+            auto ciphertextC = CKKSContext->Encrypt(CKKSKeypair.publicKey, plaintextC);
+
+            std::vector < std::pair < Ciphertext<DCRTPoly>, size_t > > results;
+            results.emplace_back(client.Call(server::ADD, vectorB.size(), {ciphertextA, ciphertextB}), vectorB.size());
+            results.emplace_back(client.Call(server::MULTIPLY, vectorB.size(), {ciphertextA, ciphertextB}), vectorB.size());
+            results.emplace_back(client.Call(server::SIGMOID, vectorC.size(), {ciphertextC}), vectorC.size());
+
+            std::lock_guard <std::mutex> lock(printing);
+            std::cout << "client " << c << " (" << client.BytesReceived() << " bytes received)" << std::endl;
+            for (auto &result: results){
+                Plaintext plaintext;
+                CKKSContext->Decrypt(CKKSKeypair.secretKey, result.first, &plaintext);
+                plaintext->SetLength(result.second);
+                std::cout << plaintext << std::endl;
+            }
+        });
+    }
+    for (auto &thread: threads)
+        thread.join();
+
+    evaluator.Stop();
+    serving.join();
+
+    return 0;
+}
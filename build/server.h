@@ -0,0 +1,570 @@
+#pragma once
+
+#include <openfhe.h>
+#include "activation_function.h"
+#include "batch.h"
+#include "keystore.h"
+#include "tuner.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Evaluation daemon for the add, multiply and activation operators. Clients send
+// serialized CKKS ciphertexts over a Unix socket or loopback TCP, each holding a short
+// vector in its first slots. Activation requests that arrive within a short window are
+// coalesced: request i is masked to its length and moved to offset i * blockWidth, the
+// requests are summed into one ciphertext, and the activation runs once over every slot.
+// Each result is rotated back to slot 0, masked to its own length with a 0/1 plaintext,
+// compressed to the last tower and sent back; add and multiply skip the packing. Both
+// directions compose power-of-two shifts, so the key count grows with log2(maxBatch).
+//
+// Addresses are "unix:<path>" or "tcp:<port>"; TCP only binds the loopback interface.
+//
+// request:  u32 op, u32 length, u32 count, then count ciphertext frames
+// response: u32 status (0 on success), then one frame with the ciphertext or the error
+// frame:    u64 size in network byte order, then size bytes of binary serialization
+namespace server {
+
+using namespace lbcrypto;
+
+enum Op : uint32_t { ADD, MULTIPLY, SIGMOID, TANH, SWISH, GELU };
+
+struct Options {
+    uint32_t blockWidth = 16;   // slots reserved per coalesced request, a power of two
+    uint32_t maxBatch = 64;     // requests per packed ciphertext
+    std::chrono::microseconds window{2000};
+    double lowerBound = -8;     // activation input range
+    double upperBound = 8;
+    uint32_t polyDegree = 16;
+    double maxInput = 1 << 10;  // bound on multiply operands
+};
+
+inline uint32_t arity(Op op){
+    return op == ADD || op == MULTIPLY ? 2 : 1;
+}
+
+// rotations used for packing and unpacking, to be generated by the key owner: the
+// power-of-two multiples of blockWidth below maxBatch * blockWidth, in both directions
+inline std::vector <int32_t> rotationIndices(const Options &options){
+    std::vector <int32_t> res;
+    for (uint32_t step = 1; step < options.maxBatch; step <<= 1){
+        res.push_back(step * options.blockWidth);
+        res.push_back(-static_cast<int32_t>(step * options.blockWidth));
+    }
+    return res;
+}
+
+// CKKS context deep enough for the activation between the packing and unpacking masks,
+// loaded from storeDir when a store exists there and generated and saved to it otherwise
+inline keystore::Store evaluationContext(const std::string &storeDir, const Options &options){
+    CryptoContext<DCRTPoly> CKKSContext;
+    KeyPair<DCRTPoly> CKKSKeypair;
+    if (keystore::Exists(storeDir)){
+        auto store = keystore::Load(storeDir);
+        CKKSContext = store.cryptoContext;
+        CKKSKeypair = store.keyPair;
+        keystore::LoadRotationKeys(storeDir, CKKSContext, rotationIndices(options), CKKSKeypair.publicKey->GetKeyTag());
+        return {CKKSContext, CKKSKeypair};
+    }
+
+    // the square covers the multiply range and one mask, the trailing product the other mask
+    // around a coalesced activation
+    tuner::Workload workload;
+    workload.ops = {{tuner::SQUARE}, {tuner::CHEBYSHEV, options.polyDegree, std::max(-options.lowerBound, options.upperBound)}, {tuner::MULT}};
+    workload.vectorLength = options.blockWidth * options.maxBatch;
+    workload.maxInput = std::max({options.maxInput, -options.lowerBound, options.upperBound});
+    auto CKKSParams = tuner::Tune<CryptoContextCKKSRNS>(workload);
+    CKKSContext = GenCryptoContext(CKKSParams);
+    CKKSContext->Enable(PKE);
+    CKKSContext->Enable(KEYSWITCH);
+    CKKSContext->Enable(LEVELEDSHE);
+    CKKSContext->Enable(ADVANCEDSHE);
+
+    CKKSKeypair = CKKSContext->KeyGen();
+    CKKSContext->EvalMultKeyGen(CKKSKeypair.secretKey);
+    CKKSContext->EvalRotateKeyGen(CKKSKeypair.secretKey, rotationIndices(options));
+    keystore::Save(storeDir, CKKSContext, CKKSKeypair);
+    return {CKKSContext, CKKSKeypair};
+}
+
+inline void sendAll(int fd, const void *data, size_t size){
+    auto bytes = static_cast<const char *>(data);
+    while (size > 0){
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            throw std::runtime_error("connection closed while sending");
+        bytes += sent;
+        size -= sent;
+    }
+}
+
+inline void receiveAll(int fd, void *data, size_t size){
+    auto bytes = static_cast<char *>(data);
+    while (size > 0){
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received <= 0)
+            throw std::runtime_error("connection closed while receiving");
+        bytes += received;
+        size -= received;
+    }
+}
+
+inline void sendWord(int fd, uint32_t value){
+    value = htonl(value);
+    sendAll(fd, &value, sizeof(value));
+}
+
+inline uint32_t receiveWord(int fd){
+    uint32_t value;
+    receiveAll(fd, &value, sizeof(value));
+    return ntohl(value);
+}
+
+inline void sendFrame(int fd, const std::string &bytes){
+    uint64_t size = bytes.size();
+    sendWord(fd, size >> 32);
+    sendWord(fd, size & 0xffffffff);
+    sendAll(fd, bytes.data(), bytes.size());
+}
+
+inline std::string receiveFrame(int fd, uint64_t maxSize = UINT64_MAX){
+    uint64_t size = static_cast<uint64_t>(receiveWord(fd)) << 32;
+    size |= receiveWord(fd);
+    if (size > maxSize)
+        throw std::runtime_error("frame of " + std::to_string(size) + " bytes exceeds the limit of " + std::to_string(maxSize));
+    std::string bytes(size, '\0');
+    receiveAll(fd, bytes.data(), size);
+    return bytes;
+}
+
+inline std::string serialize(const Ciphertext<DCRTPoly> &ciphertext){
+    std::ostringstream stream;
+    Serial::Serialize(ciphertext, stream, SerType::BINARY);
+    return stream.str();
+}
+
+inline Ciphertext<DCRTPoly> deserialize(const std::string &bytes){
+    std::istringstream stream(bytes);
+    Ciphertext<DCRTPoly> ciphertext;
+    Serial::Deserialize(ciphertext, stream, SerType::BINARY);
+    return ciphertext;
+}
+
+inline int openSocket(const std::string &address, bool listening){
+    int fd;
+    if (address.rfind("unix:", 0) == 0){
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::string path = address.substr(5);
+        if (path.size() >= sizeof(addr.sun_path))
+            throw std::invalid_argument("socket path too long: " + path);
+        std::strcpy(addr.sun_path, path.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error("cannot create socket for " + address);
+        if (listening)
+            unlink(path.c_str());
+        int status = listening ? bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) : connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        if (status != 0){
+            close(fd);
+            throw std::runtime_error("cannot " + std::string(listening ? "bind " : "connect to ") + address);
+        }
+    }
+    else if (address.rfind("tcp:", 0) == 0){
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(std::stoi(address.substr(4)));
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error("cannot create socket for " + address);
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        int status = listening ? bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) : connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        if (status != 0){
+            close(fd);
+            throw std::runtime_error("cannot " + std::string(listening ? "bind " : "connect to ") + address);
+        }
+    }
+    else
+        throw std::invalid_argument("address must be unix:<path> or tcp:<port>, got " + address);
+
+    if (listening && listen(fd, SOMAXCONN) != 0){
+        close(fd);
+        throw std::runtime_error("cannot listen on " + address);
+    }
+    return fd;
+}
+
+// An activation is worth sharing: its one evaluation costs far more than the roughly three
+// key switches a request pays to be packed and unpacked. Add needs no key switch and
+// multiply one, so packing would make them slower; those run directly on the caller.
+inline bool coalesced(Op op){
+    return op != ADD && op != MULTIPLY;
+}
+
+// Collects activation requests per operator and evaluates them in slot-packed groups on one
+// worker thread; the rotations within each tree level run through batch::ParallelFor. Requests
+// longer than blockWidth, and the operators that are not coalesced, are evaluated on their
+// own. Every result is masked to its length and compressed to the last tower.
+class Coalescer {
+public:
+    Coalescer(CryptoContext<DCRTPoly> cryptoContext, const Options &options) : cryptoContext(cryptoContext), options(options) {
+        slots = cryptoContext->GetEncodingParams()->GetBatchSize();
+        if (slots == 0)
+            slots = cryptoContext->GetRingDimension() / 2;
+        capacity = std::max<uint32_t>(std::min(options.maxBatch, slots / options.blockWidth), 1);
+        worker = std::thread([this](){ run(); });
+    }
+
+    ~Coalescer(){
+        {
+            std::lock_guard <std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        worker.join();
+    }
+
+    Coalescer(const Coalescer &) = delete;
+    Coalescer &operator=(const Coalescer &) = delete;
+
+    Ciphertext<DCRTPoly> Evaluate(Op op, uint32_t length, std::vector < Ciphertext<DCRTPoly> > args){
+        if (op > GELU)
+            throw std::invalid_argument("unknown operator " + std::to_string(op));
+        if (args.size() != arity(op))
+            throw std::invalid_argument("operator " + std::to_string(op) + " takes " + std::to_string(arity(op)) + " ciphertexts, got " + std::to_string(args.size()));
+        if (length == 0 || length > slots)
+            throw std::invalid_argument("length " + std::to_string(length) + " is outside 1.." + std::to_string(slots));
+        if (!coalesced(op) || length > options.blockWidth)
+            return finish(apply(op, args), length);
+
+        Pending request{length, std::move(args), {}};
+        auto res = request.result.get_future();
+        {
+            std::lock_guard <std::mutex> lock(mutex);
+            if (stopping)
+                throw std::runtime_error("server is stopping");
+            pending[op].push_back(std::move(request));
+            ++queued;
+        }
+        ready.notify_all();
+        return res.get();
+    }
+
+private:
+    struct Pending {
+        uint32_t length;
+        std::vector < Ciphertext<DCRTPoly> > args;
+        std::promise < Ciphertext<DCRTPoly> > result;
+    };
+
+    // 0/1 plaintexts are cached per length and level; encoding is serialized, since the
+    // encoding tables must not be built from several threads at once
+    Plaintext mask(uint32_t length, size_t level){
+        std::lock_guard <std::mutex> lock(maskMutex);
+        auto key = std::make_pair(length, level);
+        auto it = masks.find(key);
+        if (it == masks.end())
+            it = masks.emplace(key, cryptoContext->MakeCKKSPackedPlaintext(std::vector <double>(length, 1.0), 1, level)).first;
+        return it->second;
+    }
+
+    Ciphertext<DCRTPoly> finish(Ciphertext<DCRTPoly> result, uint32_t length){
+        return cryptoContext->Compress(cryptoContext->EvalMult(result, mask(length, result->GetLevel())), 1);
+    }
+
+    bool full() const {
+        for (const auto &entry: pending)
+            if (entry.second.size() >= capacity)
+                return true;
+        return false;
+    }
+
+    void run(){
+        std::unique_lock <std::mutex> lock(mutex);
+        while (true){
+            ready.wait(lock, [this](){ return stopping || queued > 0; });
+            if (queued == 0)
+                return;
+            // the first request waits one window for others to share its ciphertext
+            ready.wait_for(lock, options.window, [this](){ return stopping || full(); });
+            auto groups = std::move(pending);
+            pending.clear();
+            queued = 0;
+            lock.unlock();
+            for (auto &entry: groups)
+                evaluateGroup(entry.first, entry.second);
+            lock.lock();
+        }
+    }
+
+    void evaluateGroup(Op op, std::vector <Pending> &group){
+        for (size_t start = 0; start < group.size(); start += capacity){
+            std::vector <Pending *> chunk;
+            for (size_t i = start; i < group.size() && i < start + capacity; ++i)
+                chunk.push_back(&group[i]);
+            evaluate(op, chunk);
+        }
+    }
+
+    Ciphertext<DCRTPoly> apply(Op op, const std::vector < Ciphertext<DCRTPoly> > &args){
+        switch (op){
+            case ADD: return cryptoContext->EvalAdd(args[0], args[1]);
+            case MULTIPLY: return cryptoContext->EvalMult(args[0], args[1]);
+            case SIGMOID: return activation::sigmoid(cryptoContext, args[0], options.lowerBound, options.upperBound, options.polyDegree);
+            case TANH: return activation::tanh(cryptoContext, args[0], options.lowerBound, options.upperBound, options.polyDegree);
+            case SWISH: return activation::swish(cryptoContext, args[0], options.lowerBound, options.upperBound, options.polyDegree);
+            case GELU: return activation::gelu(cryptoContext, args[0], options.lowerBound, options.upperBound, options.polyDegree);
+        }
+        throw std::invalid_argument("unknown operator " + std::to_string(op));
+    }
+
+    // Every argument is masked to its declared length before it is shifted into its block:
+    // the server cannot see whether a client left the remaining slots empty, and data there
+    // would land in the other requests' blocks.
+    // request i is one rotation by lowbit(i) * blockWidth away from request i - lowbit(i),
+    // so every rotation uses a power-of-two key; the rotations of one parent share a single
+    // hoisted precompute, and the root alone feeds log2(count) of them
+    std::vector < Ciphertext<DCRTPoly> > unpack(const Ciphertext<DCRTPoly> &result, size_t count) const {
+        std::vector < Ciphertext<DCRTPoly> > nodes(count);
+        nodes[0] = result;
+        uint32_t cyclotomicOrder = cryptoContext->GetCyclotomicOrder();
+        std::vector <size_t> parents{0};
+        while (!parents.empty()){
+            std::vector <size_t> sources;
+            std::vector < std::pair <size_t, size_t> > edges;
+            for (size_t p: parents){
+                size_t limit = p == 0 ? count : (p & (~p + 1));
+                if (p + 1 >= count || limit == 1)
+                    continue;
+                for (size_t step = 1; step < limit && p + step < count; step <<= 1)
+                    edges.emplace_back(sources.size(), step);
+                sources.push_back(p);
+            }
+            std::vector < std::shared_ptr < std::vector <DCRTPoly> > > precomputed(sources.size());
+            batch::ParallelFor(sources.size(), [&](size_t s){
+                precomputed[s] = cryptoContext->EvalFastRotationPrecompute(nodes[sources[s]]);
+            });
+            batch::ParallelFor(edges.size(), [&](size_t e){
+                size_t s = edges[e].first, step = edges[e].second;
+                nodes[sources[s] + step] = cryptoContext->EvalFastRotation(nodes[sources[s]], step * options.blockWidth, cyclotomicOrder, precomputed[s]);
+            });
+            parents.clear();
+            for (auto &edge: edges)
+                parents.push_back(sources[edge.first] + edge.second);
+        }
+        return nodes;
+    }
+
+    void evaluate(Op op, const std::vector <Pending *> &chunk){
+        try {
+            size_t count = chunk.size();
+            std::vector < Ciphertext<DCRTPoly> > packed(arity(op));
+            for (size_t a = 0; a < packed.size(); ++a){
+                std::vector <Plaintext> inputMasks(count);
+                for (size_t i = 0; i < count; ++i)
+                    inputMasks[i] = mask(chunk[i]->length, chunk[i]->args[a]->GetLevel());
+                std::vector < Ciphertext<DCRTPoly> > nodes(count);
+                batch::ParallelFor(count, [&](size_t i){
+                    nodes[i] = cryptoContext->EvalMult(chunk[i]->args[a], inputMasks[i]);
+                });
+                // pairwise tree: after the level with the given step, node i holds requests
+                // i .. i + 2 * step - 1 at their offsets relative to slot 0
+                for (size_t step = 1; step < count; step <<= 1){
+                    std::vector <size_t> targets;
+                    for (size_t i = 0; i + step < count; i += 2 * step)
+                        targets.push_back(i);
+                    batch::ParallelFor(targets.size(), [&](size_t t){
+                        size_t i = targets[t];
+                        auto shifted = cryptoContext->EvalRotate(nodes[i + step], -static_cast<int32_t>(step * options.blockWidth));
+                        cryptoContext->EvalAddInPlace(nodes[i], shifted);
+                    });
+                }
+                packed[a] = nodes[0];
+            }
+            auto result = apply(op, packed);
+
+            for (size_t i = 0; i < count; ++i)
+                mask(chunk[i]->length, result->GetLevel());
+            std::vector < Ciphertext<DCRTPoly> > unpacked = unpack(result, count);
+            batch::ParallelFor(count, [&](size_t i){
+                unpacked[i] = finish(unpacked[i], chunk[i]->length);
+            });
+            for (size_t i = 0; i < count; ++i)
+                chunk[i]->result.set_value(unpacked[i]);
+        }
+        catch (...){
+            for (auto request: chunk)
+                request->result.set_exception(std::current_exception());
+        }
+    }
+
+    CryptoContext<DCRTPoly> cryptoContext;
+    Options options;
+    uint32_t slots;
+    uint32_t capacity;
+    std::map < Op, std::vector <Pending> > pending;
+    size_t queued = 0;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::thread worker;
+    std::map < std::pair <uint32_t, size_t>, Plaintext > masks;
+    std::mutex maskMutex;
+};
+
+// Serialized size of a 2-element ciphertext at full level, with room for the serialization
+// headers; larger frames are rejected before anything is allocated for them.
+inline uint64_t maxFrameSize(CryptoContext<DCRTPoly> cryptoContext){
+    size_t towers = cryptoContext->GetElementParams()->GetParams().size();
+    return 2 * towers * cryptoContext->GetRingDimension() * sizeof(uint64_t) + (1 << 16);
+}
+
+// one detached thread per connection; each connection has at most one request in flight,
+// so concurrency, and with it coalescing, comes from concurrent clients
+class Server {
+public:
+    Server(CryptoContext<DCRTPoly> cryptoContext, const Options &options) : coalescer(cryptoContext, options), frameLimit(maxFrameSize(cryptoContext)) {}
+
+    ~Server(){
+        Stop();
+        std::unique_lock <std::mutex> lock(mutex);
+        finished.wait(lock, [this](){ return clients.empty(); });
+        if (listenFd >= 0)
+            close(listenFd);
+    }
+
+    void Listen(const std::string &address){
+        listenFd = openSocket(address, true);
+    }
+
+    // returns once Stop() is called and every connection has closed
+    void Serve(){
+        while (true){
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0)
+                break;
+            std::lock_guard <std::mutex> lock(mutex);
+            if (stopped){
+                close(fd);
+                break;
+            }
+            clients.insert(fd);
+            std::thread([this, fd](){ handle(fd); }).detach();
+        }
+        std::unique_lock <std::mutex> lock(mutex);
+        finished.wait(lock, [this](){ return clients.empty(); });
+    }
+
+    void Stop(){
+        std::lock_guard <std::mutex> lock(mutex);
+        if (stopped)
+            return;
+        stopped = true;
+        if (listenFd >= 0)
+            shutdown(listenFd, SHUT_RDWR);
+        for (int fd: clients)
+            shutdown(fd, SHUT_RDWR);
+    }
+
+private:
+    void handle(int fd){
+        try {
+            while (true){
+                auto op = static_cast<Op>(receiveWord(fd));
+                uint32_t length = receiveWord(fd);
+                uint32_t count = receiveWord(fd);
+                // a malformed header leaves the stream out of step, so the connection ends
+                if (op > GELU || count != arity(op)){
+                    sendWord(fd, 1);
+                    sendFrame(fd, "operator " + std::to_string(op) + " with " + std::to_string(count) + " ciphertexts is not supported");
+                    break;
+                }
+                std::vector < Ciphertext<DCRTPoly> > args;
+                for (uint32_t i = 0; i < count; ++i)
+                    args.push_back(deserialize(receiveFrame(fd, frameLimit)));
+
+                std::string reply;
+                uint32_t status = 0;
+                try {
+                    reply = serialize(coalescer.Evaluate(op, length, std::move(args)));
+                }
+                catch (const std::exception &error){
+                    status = 1;
+                    reply = error.what();
+                }
+                sendWord(fd, status);
+                sendFrame(fd, reply);
+            }
+        }
+        catch (const std::exception &){
+            // the client hung up, sent an oversized frame, or the server is stopping
+        }
+        std::lock_guard <std::mutex> lock(mutex);
+        clients.erase(fd);
+        close(fd);
+        finished.notify_all();
+    }
+
+    Coalescer coalescer;
+    uint64_t frameLimit;
+    int listenFd = -1;
+    bool stopped = false;
+    std::set <int> clients;
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+class Client {
+public:
+    explicit Client(const std::string &address) : fd(openSocket(address, false)) {}
+
+    ~Client(){
+        close(fd);
+    }
+
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    // length is the number of leading slots of the arguments that hold data
+    Ciphertext<DCRTPoly> Call(Op op, uint32_t length, const std::vector < Ciphertext<DCRTPoly> > &args){
+        sendWord(fd, op);
+        sendWord(fd, length);
+        sendWord(fd, args.size());
+        for (const auto &arg: args)
+            sendFrame(fd, serialize(arg));
+
+        uint32_t status = receiveWord(fd);
+        auto reply = receiveFrame(fd);
+        if (status != 0)
+            throw std::runtime_error(reply);
+        bytesReceived += reply.size();
+        return deserialize(reply);
+    }
+
+    size_t BytesReceived() const {
+        return bytesReceived;
+    }
+
+private:
+    int fd;
+    size_t bytesReceived = 0;
+};
+
+}
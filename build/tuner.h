@@ -0,0 +1,249 @@
+#pragma once
+
+#include <openfhe.h>
+#include "activation_function.h"
+#include "matrix_multiplication.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Picks the smallest secure CCParams for a described workload. The operator sequence gives
+// the multiplicative depth and, by interval propagation from maxInput, the largest value
+// the computation produces; that bounds the plaintext modulus for BGV/BFV and the first
+// modulus for CKKS, whose scaling modulus follows from the required precision. OpenFHE
+// then picks the smallest ring dimension that keeps the modulus chain secure, and the
+// tuner raises it only when the vectors would not fit in the slots. The ring's full slot
+// count is handed back as the batch size, since unused slots cost nothing.
+namespace tuner {
+
+using namespace lbcrypto;
+
+enum Op {
+    ADD,        // current + value of the same range
+    MULT,       // current * fresh input
+    SQUARE,     // current * current
+    ROTATE,
+    SUM,        // sum of count slots
+    CHEBYSHEV   // activation of degree count with outputs bounded by bound (CKKS only)
+};
+
+struct Step {
+    Op op;
+    uint32_t count = 0;
+    double bound = 0;
+};
+
+struct Workload {
+    std::vector <Step> ops;
+    size_t vectorLength = 1;
+    double maxInput = 1;
+    double precisionBits = 20;  // CKKS: required bits after the binary point
+    SecurityLevel security = HEStd_128_classic;
+};
+
+// bits CKKS loses to encryption, rescaling and key switching noise
+constexpr uint32_t CKKS_NOISE_BITS = 12;
+constexpr uint32_t MAX_MOD_SIZE = 60;
+constexpr uint32_t PROBE_RING_DIM = 1 << 16;
+
+struct Analysis {
+    uint32_t depth = 0;
+    double maxValue = 0;
+};
+
+inline Analysis analyze(const Workload &workload, bool ckks){
+    Analysis res;
+    double value = workload.maxInput;
+    res.maxValue = value;
+    for (const auto &step: workload.ops){
+        switch (step.op){
+            case ADD: value *= 2; break;
+            case MULT: value *= workload.maxInput; ++res.depth; break;
+            case SQUARE: value *= value; ++res.depth; break;
+            case ROTATE: break;
+            case SUM: value *= std::max<uint32_t>(step.count, 1); break;
+            case CHEBYSHEV:
+                if (!ckks)
+                    throw std::invalid_argument("Chebyshev activations need CKKS");
+                res.depth += activation::activationDepth(step.count);
+                value = step.bound;
+                break;
+        }
+        res.maxValue = std::max(res.maxValue, value);
+    }
+    res.depth = std::max<uint32_t>(res.depth, 1);
+    return res;
+}
+
+inline uint64_t mulMod(uint64_t a, uint64_t b, uint64_t mod){
+    return static_cast<unsigned __int128>(a) * b % mod;
+}
+
+inline uint64_t powMod(uint64_t base, uint64_t exp, uint64_t mod){
+    uint64_t res = 1;
+    for (base %= mod; exp; exp >>= 1, base = mulMod(base, base, mod))
+        if (exp & 1)
+            res = mulMod(res, base, mod);
+    return res;
+}
+
+// deterministic Miller-Rabin for 64-bit integers
+inline bool isPrime(uint64_t n){
+    if (n < 2)
+        return false;
+    for (uint64_t p: {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37})
+        if (n % p == 0)
+            return n == p;
+    uint64_t d = n - 1;
+    uint32_t s = 0;
+    for (; d % 2 == 0; d /= 2)
+        ++s;
+    for (uint64_t a: {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37}){
+        uint64_t x = powMod(a, d, n);
+        if (x == 1 || x == n - 1)
+            continue;
+        bool composite = true;
+        for (uint32_t r = 1; r < s && composite; ++r){
+            x = mulMod(x, x, n);
+            composite = x != n - 1;
+        }
+        if (composite)
+            return false;
+    }
+    return true;
+}
+
+// smallest prime above 2 * maxValue that supports packing at this ring dimension
+inline uint64_t plaintextModulus(double maxValue, uint32_t ringDim){
+    uint64_t step = 2 * static_cast<uint64_t>(ringDim);
+    double limit = std::ldexp(1.0, MAX_MOD_SIZE);
+    if (2 * maxValue + 1 >= limit)
+        throw std::invalid_argument("values up to " + std::to_string(maxValue) + " do not fit a " + std::to_string(MAX_MOD_SIZE) + "-bit plaintext modulus");
+    uint64_t p = (static_cast<uint64_t>(2 * maxValue) / step + 1) * step + 1;
+    while (!isPrime(p))
+        p += step;
+    return p;
+}
+
+template <typename Scheme>
+CCParams<Scheme> Tune(const Workload &workload){
+    constexpr bool ckks = std::is_same<Scheme, CryptoContextCKKSRNS>::value;
+    auto analysis = analyze(workload, ckks);
+    // CKKS packs N/2 slots; BGV/BFV pack N, but rotations act on each of two N/2-slot rows,
+    // which is also all matmul::slotCount hands out
+    bool rotates = std::any_of(workload.ops.begin(), workload.ops.end(), [](const Step &step){ return step.op == ROTATE || step.op == SUM; });
+    uint32_t minRingDim = std::max<uint32_t>(matmul::nextPowerOfTwo(workload.vectorLength) * (ckks || rotates ? 2 : 1), 1024);
+
+    CCParams<Scheme> params;
+    params.SetSecurityLevel(workload.security);
+    params.SetMultiplicativeDepth(analysis.depth);
+    if constexpr (ckks){
+        uint32_t scalingModSize = std::clamp<uint32_t>(std::ceil(workload.precisionBits) + CKKS_NOISE_BITS, 20, MAX_MOD_SIZE - 1);
+        uint32_t firstModSize = scalingModSize + static_cast<uint32_t>(std::ceil(std::log2(analysis.maxValue + 1))) + 1;
+        if (firstModSize > MAX_MOD_SIZE)
+            throw std::invalid_argument("values up to " + std::to_string(analysis.maxValue) + " at " + std::to_string(workload.precisionBits) + " bits of precision need a " + std::to_string(firstModSize) + "-bit first modulus");
+        params.SetScalingModSize(scalingModSize);
+        params.SetFirstModSize(firstModSize);
+        params.SetScalingTechnique(FLEXIBLEAUTO);
+    }
+
+    // the secure ring dimension is probed with a plaintext modulus that packs at any ring
+    // up to PROBE_RING_DIM, which is at least as large as the final one
+    if constexpr (!ckks)
+        params.SetPlaintextModulus(plaintextModulus(analysis.maxValue, PROBE_RING_DIM));
+    uint32_t ringDim = std::max(GenCryptoContext(params)->GetRingDimension(), minRingDim);
+
+    params.SetRingDim(ringDim);
+    params.SetBatchSize(ckks ? ringDim / 2 : ringDim);
+    if constexpr (!ckks)
+        params.SetPlaintextModulus(plaintextModulus(analysis.maxValue, ringDim));
+    GenCryptoContext(params);
+    return params;
+}
+
+// runs the workload's operator sequence once on fresh ciphertexts
+inline void run(CryptoContext<DCRTPoly> cryptoContext, const Workload &workload, KeyPair<DCRTPoly> keyPair, bool ckks){
+    std::vector <double> real(workload.vectorLength, workload.maxInput / 2);
+    std::vector <int64_t> integer(workload.vectorLength, 1);
+    auto plaintext = ckks ? cryptoContext->MakeCKKSPackedPlaintext(real) : cryptoContext->MakePackedPlaintext(integer);
+    auto fresh = cryptoContext->Encrypt(keyPair.publicKey, plaintext);
+    auto current = fresh;
+    for (const auto &step: workload.ops){
+        switch (step.op){
+            case ADD: current = cryptoContext->EvalAdd(current, current); break;
+            case MULT: current = cryptoContext->EvalMult(current, fresh); break;
+            case SQUARE: current = cryptoContext->EvalSquare(current); break;
+            case ROTATE: current = cryptoContext->EvalRotate(current, 1); break;
+            case SUM: current = cryptoContext->EvalSum(current, matmul::nextPowerOfTwo(step.count)); break;
+            case CHEBYSHEV: current = activation::sigmoid(cryptoContext, current, -workload.maxInput, workload.maxInput, step.count); break;
+        }
+    }
+    Plaintext result;
+    cryptoContext->Decrypt(keyPair.secretKey, current, &result);
+}
+
+// Empirical mode: starts from Tune() and micro-benchmarks the scaling techniques and
+// key-switching digit counts that keep the same ring, returning the fastest candidate that
+// runs the workload end to end.
+template <typename Scheme>
+CCParams<Scheme> TuneEmpirical(const Workload &workload, size_t iterations = 5){
+    constexpr bool ckks = std::is_same<Scheme, CryptoContextCKKSRNS>::value;
+    constexpr bool bfv = std::is_same<Scheme, CryptoContextBFVRNS>::value;
+    auto base = Tune<Scheme>(workload);
+
+    std::vector < CCParams<Scheme> > candidates;
+    std::vector <ScalingTechnique> techniques = {base.GetScalingTechnique()};
+    if (!bfv)
+        techniques = {FLEXIBLEAUTO, FIXEDAUTO};
+    for (auto technique: techniques){
+        for (uint32_t digits: {0u, 2u, 3u}){
+            auto candidate = base;
+            candidate.SetScalingTechnique(technique);
+            candidate.SetNumLargeDigits(digits);
+            candidates.push_back(candidate);
+        }
+    }
+
+    auto best = base;
+    double bestMillis = std::numeric_limits<double>::infinity();
+    for (const auto &candidate: candidates){
+        try {
+            auto cryptoContext = GenCryptoContext(candidate);
+            if (cryptoContext->GetRingDimension() != base.GetRingDim())
+                continue;
+            cryptoContext->Enable(PKE);
+            cryptoContext->Enable(KEYSWITCH);
+            cryptoContext->Enable(LEVELEDSHE);
+            cryptoContext->Enable(ADVANCEDSHE);
+            auto keyPair = cryptoContext->KeyGen();
+            cryptoContext->EvalMultKeyGen(keyPair.secretKey);
+            cryptoContext->EvalRotateKeyGen(keyPair.secretKey, std::vector <int32_t>{1});
+            cryptoContext->EvalSumKeyGen(keyPair.secretKey);
+
+            std::vector <double> millis;
+            for (size_t i = 0; i < iterations; ++i){
+                auto start = std::chrono::steady_clock::now();
+                run(cryptoContext, workload, keyPair, ckks);
+                auto end = std::chrono::steady_clock::now();
+                millis.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            }
+            std::sort(millis.begin(), millis.end());
+            double median = millis[millis.size() / 2];
+            if (median < bestMillis){
+                bestMillis = median;
+                best = candidate;
+            }
+        }
+        catch (const std::exception &){
+            // candidates that are insecure or too shallow for the workload are skipped
+        }
+    }
+    return best;
+}
+
+}